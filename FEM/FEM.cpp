@@ -9,7 +9,10 @@
 * 
 * The problem domain is regularly subdivided with triangles. An integer
 * as command line parameter gives the number of elements (2x) per axis.
-* The standard is 20.
+* The standard is 20. Alternatively a mesh file (Gmsh .msh or Triangle
+* .node/.ele) can be given; it is rendered in its own coordinates.
+* An optional second parameter names a file caching the assembled 
+* system; it is used if it matches the mesh and written otherwise.
 *
 * Physically-Based Simulation Proseminar WS 2015
 *
@@ -93,21 +96,51 @@ int main(int argc, char *argv[])
 {
     /* Mesh resoluion: gridxgridx2 triangles */
     int grid = 20;    
+    const char *meshFile = NULL;
+    const char *cacheFile = NULL;
 
-    if(argc == 2)
+    if(argc >= 2)
+    {
         grid = atoi(argv[1]);
+        if(grid <= 0)
+            meshFile = argv[1];
+    }
+    if(argc >= 3)
+        cacheFile = argv[2];
 
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
 
-    model.CreateUniformGridMesh(grid, grid);   
+    if(meshFile)
+    {
+        if(!model.LoadMesh(meshFile))
+        {
+            cout << "Could not read mesh " << meshFile << endl;
+            return 1;
+        }
+    }
+    else
+        model.CreateUniformGridMesh(grid, grid);   
 
-    model.AssembleStiffnessMatrix();           
-    model.ComputeRHS();
-    model.SetBoundaryConditions();
+    bool cached = cacheFile && model.LoadSystem(cacheFile);
+    if(cached)
+        cout << "Loaded system from " << cacheFile << endl;
+    else
+    {
+        model.AssembleStiffnessMatrix();           
+        model.ComputeRHS();
+        model.SetBoundaryConditions();
+    }
     
     model.Solve();
 
+    if(cacheFile && !cached && !model.SaveSystem(cacheFile))
+        cout << "Could not write " << cacheFile << endl;
+
+    const SolverStats &stats = model.GetSolverStats();
+    cout << "Solved in " << stats.iterations << " iterations, " 
+         << stats.timeTotal << " s" << endl;
+
     double err_nrm = model.ComputeError();
     cout << "Error norm is " << err_nrm << endl;
 
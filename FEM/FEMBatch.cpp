@@ -0,0 +1,447 @@
+/******************************************************************
+*
+* FEMBatch.cpp
+*
+* Description: Headless driver for the Finite Element model, used as
+* regression benchmark for the solvers. For every combination of grid
+* resolution and solver it runs mesh generation, stiffness assembly,
+* right-hand side, boundary conditions, Solve and error computation on
+* a fresh model and records the time of each phase, the solver
+* statistics, the peak resident memory and the error norms. Results
+* are written as CSV (default) or JSON.
+*
+* With --adapt N every run continues with N adaptive cycles: estimate
+* the error, mark elements (Doerfler, theta = 0.5), refine and solve
+* again. Each cycle gives one more record; its mesh time is the 
+* refinement including the incremental update of matrix and right-hand
+* side.
+*
+* --orders selects the element orders (1: linear, 2: quadratic) to
+* compare; every grid and solver runs with each of them. The total 
+* time (all phases) against the error norms gives the error vs. wall
+* clock curve of each order.
+*
+* Usage: FEMBatch [--grids 33,65,129] [--solvers jacobi,amg,...]
+*                 [--orders 1,2] [--variant standard|fused|pipelined]
+*                 [--adapt N] [--format csv|json] [--output file]
+*
+* Grids are given in vertices per axis, like the FEM parameter. Solvers:
+* jacobi, ic0, gmg, amg (PCG with that preconditioner), direct,
+* mixed-jacobi, mixed-ic0, mixed-gmg, mixed-amg (mixed precision, for
+* comparison only: slower than the double solves, hence not part of 
+* the default list) and matrixfree (Jacobi PCG on the stencil 
+* operator).
+*
+* The peak memory is reset before each run where the kernel supports
+* it (/proc/self/clear_refs, Linux 4.0 and later), after returning the
+* memory freed by earlier runs (malloc_trim, glibc); otherwise it is 
+* the high-water mark of the whole process so far.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+/* Standard includes */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+/* Local includes */
+#include "FEModel.h"
+
+/*----------------------------------------------------------------*/
+struct SolverConfig
+{
+    const char *name;
+    SolverType solver;
+    PreconditionerType precond;
+    bool mixedPrecision;
+    bool matrixFree;
+};
+
+static const SolverConfig solverConfigs[] =
+{
+    { "jacobi",       SOLVER_PCG,    PRECOND_JACOBI, false, false },
+    { "ic0",          SOLVER_PCG,    PRECOND_IC0,    false, false },
+    { "gmg",          SOLVER_PCG,    PRECOND_GMG,    false, false },
+    { "amg",          SOLVER_PCG,    PRECOND_AMG,    false, false },
+    { "direct",       SOLVER_DIRECT, PRECOND_JACOBI, false, false },
+    { "mixed-jacobi", SOLVER_PCG,    PRECOND_JACOBI, true,  false },
+    { "mixed-ic0",    SOLVER_PCG,    PRECOND_IC0,    true,  false },
+    { "mixed-gmg",    SOLVER_PCG,    PRECOND_GMG,    true,  false },
+    { "mixed-amg",    SOLVER_PCG,    PRECOND_AMG,    true,  false },
+    { "matrixfree",   SOLVER_PCG,    PRECOND_JACOBI, false, true  }
+};
+
+static const int numSolverConfigs = sizeof(solverConfigs) / sizeof(solverConfigs[0]);
+
+const double ADAPT_THETA = 0.5;
+
+struct BatchResult
+{
+    int grid;
+    int order; /* Element order */
+    int cycle; /* Adaptive refinement cycle, 0 for the initial mesh */
+    int numNodes;
+    int numElements;
+    const char *solver;
+    SolverStats stats;
+    double timeMesh;
+    double timeAssemble;
+    double timeRHS;
+    double timeBoundary;
+    double timeSolve;
+    double timeError;
+    long peakMemoryKB;
+    double maxError;
+    double l2Error;
+    double energyError;
+    double estimate; /* Error estimator, 0 unless adapting */
+};
+
+
+/******************************************************************
+*
+*******************************************************************/
+
+/* clear_refs resets the high-water mark to the current resident size,
+   so heap pages freed by earlier runs are handed back to the kernel 
+   first; otherwise they would count towards the next run */
+static void ResetPeakMemory()
+{
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+
+    FILE *file = fopen("/proc/self/clear_refs", "w");
+    if(file)
+    {
+        fputs("5", file);
+        fclose(file);
+    }
+}
+
+static long GetPeakMemoryKB()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static double TotalTime(const BatchResult &r)
+{
+    return r.timeMesh + r.timeAssemble + r.timeRHS + r.timeBoundary + r.timeSolve + r.timeError;
+}
+
+static void RunModel(int grid, int order, const SolverConfig &config, PCGVariant variant,
+                     int adaptCycles, vector<BatchResult> &results)
+{
+    BatchResult result;
+    result.grid = grid;
+    result.order = order;
+    result.solver = config.name;
+
+    ResetPeakMemory();
+
+    FEModel model;
+    model.SetSolver(config.solver);
+    model.SetPreconditioner(config.precond);
+    model.SetMixedPrecision(config.mixedPrecision);
+    model.SetMatrixFree(config.matrixFree);
+    model.SetPCGVariant(variant);
+    model.SetElementOrder(order);
+
+    SolverTimer timer;
+
+    model.CreateUniformGridMesh(grid, grid);
+    result.timeMesh = timer.Lap();
+
+    model.AssembleStiffnessMatrix();
+    result.timeAssemble = timer.Lap();
+
+    model.ComputeRHS();
+    result.timeRHS = timer.Lap();
+
+    model.SetBoundaryConditions();
+    result.timeBoundary = timer.Lap();
+
+    for(int cycle=0; ; cycle++)
+    {
+        model.Solve();
+        result.timeSolve = timer.Lap();
+
+        vector<double> indicators;
+        model.ComputeErrorNorms(result.maxError, result.l2Error, result.energyError);
+        result.estimate = adaptCycles > 0 ? model.EstimateError(indicators) : 0.0;
+        result.timeError = timer.Lap();
+
+        result.cycle = cycle;
+        result.numNodes = model.GetNumNodes();
+        result.numElements = model.GetNumElements();
+        result.stats = model.GetSolverStats();
+        result.peakMemoryKB = GetPeakMemoryKB();
+        results.push_back(result);
+
+        if(cycle == adaptCycles)
+            break;
+
+        timer.Lap();
+
+        vector<int> marked;
+        FEModel::MarkElements(indicators, ADAPT_THETA, marked);
+        model.RefineElements(marked);
+
+        result.timeMesh = timer.Lap();
+        result.timeAssemble = result.timeRHS = result.timeBoundary = 0.0;
+    }
+}
+
+
+/******************************************************************
+*
+*******************************************************************/
+
+static double FinalResidual(const SolverStats &stats)
+{
+    return stats.residuals.empty() ? 0.0 : stats.residuals.back();
+}
+
+static void WriteCSV(FILE *out, const vector<BatchResult> &results)
+{
+    fprintf(out, "grid,order,cycle,nodes,elements,solver,converged,iterations,refinements,residual,"
+                 "mesh_s,assemble_s,rhs_s,boundary_s,solve_s,solver_setup_s,error_s,total_s,"
+                 "peak_rss_kb,max_error,l2_error,energy_error,estimate\n");
+
+    for(int i=0; i<(int)results.size(); i++)
+    {
+        const BatchResult &r = results[i];
+        fprintf(out, "%d,%d,%d,%d,%d,%s,%d,%d,%d,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%ld,%.9g,%.9g,%.9g,%.9g\n",
+                r.grid, r.order, r.cycle, r.numNodes, r.numElements, r.solver, (int)r.stats.converged,
+                r.stats.iterations, r.stats.refinements, FinalResidual(r.stats),
+                r.timeMesh, r.timeAssemble, r.timeRHS, r.timeBoundary, r.timeSolve,
+                r.stats.timeSetup, r.timeError, TotalTime(r), r.peakMemoryKB,
+                r.maxError, r.l2Error, r.energyError, r.estimate);
+    }
+}
+
+static void WriteJSON(FILE *out, const vector<BatchResult> &results)
+{
+    fprintf(out, "[\n");
+
+    for(int i=0; i<(int)results.size(); i++)
+    {
+        const BatchResult &r = results[i];
+        fprintf(out, "  {\"grid\": %d, \"order\": %d, \"cycle\": %d, \"nodes\": %d, \"elements\": %d, \"solver\": \"%s\",\n"
+                     "   \"converged\": %s, \"iterations\": %d, \"refinements\": %d, \"residual\": %.6g,\n"
+                     "   \"time\": {\"mesh\": %.6g, \"assemble\": %.6g, \"rhs\": %.6g, \"boundary\": %.6g,"
+                     " \"solve\": %.6g, \"solver_setup\": %.6g, \"error\": %.6g, \"total\": %.6g},\n"
+                     "   \"peak_rss_kb\": %ld,\n"
+                     "   \"error\": {\"max\": %.9g, \"l2\": %.9g, \"energy\": %.9g, \"estimate\": %.9g}}%s\n",
+                r.grid, r.order, r.cycle, r.numNodes, r.numElements, r.solver,
+                r.stats.converged ? "true" : "false",
+                r.stats.iterations, r.stats.refinements, FinalResidual(r.stats),
+                r.timeMesh, r.timeAssemble, r.timeRHS, r.timeBoundary, r.timeSolve,
+                r.stats.timeSetup, r.timeError, TotalTime(r), r.peakMemoryKB,
+                r.maxError, r.l2Error, r.energyError, r.estimate,
+                i + 1 < (int)results.size() ? "," : "");
+    }
+
+    fprintf(out, "]\n");
+}
+
+
+/******************************************************************
+*
+*******************************************************************/
+
+static vector<std::string> SplitList(const char *list)
+{
+    vector<std::string> items;
+    std::string current;
+
+    for(const char *p=list; ; p++)
+    {
+        if(*p == ',' || *p == 0)
+        {
+            if(!current.empty())
+                items.push_back(current);
+            current.clear();
+
+            if(*p == 0)
+                break;
+        }
+        else
+            current += *p;
+    }
+
+    return items;
+}
+
+static void PrintUsage()
+{
+    fprintf(stderr, "Usage: FEMBatch [--grids 33,65,129] [--solvers jacobi,amg,...]\n"
+                    "                [--orders 1,2] [--variant standard|fused|pipelined]\n"
+                    "                [--adapt N] [--format csv|json] [--output file]\n"
+                    "Solvers:");
+    for(int s=0; s<numSolverConfigs; s++)
+        fprintf(stderr, " %s", solverConfigs[s].name);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *grids = "33,65,129,257";
+    const char *solvers = "jacobi,ic0,gmg,amg,direct";
+    const char *orders = "1";
+    const char *format = "csv";
+    const char *output = NULL;
+    PCGVariant variant = PCG_STANDARD;
+    int adaptCycles = 0;
+
+    for(int i=1; i<argc; i++)
+    {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if(!value)
+        {
+            PrintUsage();
+            return 1;
+        }
+
+        if(strcmp(argv[i], "--grids") == 0)
+            grids = value;
+        else if(strcmp(argv[i], "--solvers") == 0)
+            solvers = value;
+        else if(strcmp(argv[i], "--orders") == 0)
+            orders = value;
+        else if(strcmp(argv[i], "--format") == 0)
+            format = value;
+        else if(strcmp(argv[i], "--output") == 0)
+            output = value;
+        else if(strcmp(argv[i], "--adapt") == 0)
+        {
+            adaptCycles = atoi(value);
+            if(adaptCycles < 0)
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else if(strcmp(argv[i], "--variant") == 0)
+        {
+            if(strcmp(value, "standard") == 0)
+                variant = PCG_STANDARD;
+            else if(strcmp(value, "fused") == 0)
+                variant = PCG_FUSED;
+            else if(strcmp(value, "pipelined") == 0)
+                variant = PCG_PIPELINED;
+            else
+            {
+                PrintUsage();
+                return 1;
+            }
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+        i++;
+    }
+
+    if(strcmp(format, "csv") != 0 && strcmp(format, "json") != 0)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    /* Validate everything before the first (possibly long) run */
+    vector<int> gridList;
+    vector<std::string> gridItems = SplitList(grids);
+    for(int g=0; g<(int)gridItems.size(); g++)
+    {
+        int grid = atoi(gridItems[g].c_str());
+        if(grid < 3)
+        {
+            fprintf(stderr, "Invalid grid size %s\n", gridItems[g].c_str());
+            return 1;
+        }
+        gridList.push_back(grid);
+    }
+
+    vector<int> orderList;
+    vector<std::string> orderItems = SplitList(orders);
+    for(int o=0; o<(int)orderItems.size(); o++)
+    {
+        int order = atoi(orderItems[o].c_str());
+        if(order != 1 && order != 2)
+        {
+            fprintf(stderr, "Invalid element order %s\n", orderItems[o].c_str());
+            return 1;
+        }
+        if(order != 1 && adaptCycles > 0)
+        {
+            fprintf(stderr, "Adaptive refinement needs linear elements\n");
+            return 1;
+        }
+        orderList.push_back(order);
+    }
+
+    vector<const SolverConfig *> solverList;
+    vector<std::string> solverItems = SplitList(solvers);
+    for(int s=0; s<(int)solverItems.size(); s++)
+    {
+        const SolverConfig *config = NULL;
+        for(int c=0; c<numSolverConfigs; c++)
+            if(solverItems[s] == solverConfigs[c].name)
+                config = &solverConfigs[c];
+
+        if(!config)
+        {
+            fprintf(stderr, "Unknown solver %s\n", solverItems[s].c_str());
+            PrintUsage();
+            return 1;
+        }
+        solverList.push_back(config);
+    }
+
+    FILE *out = output ? fopen(output, "w") : stdout;
+    if(!out)
+    {
+        fprintf(stderr, "Could not open %s\n", output);
+        return 1;
+    }
+
+    vector<BatchResult> results;
+    for(int g=0; g<(int)gridList.size(); g++)
+    {
+        for(int o=0; o<(int)orderList.size(); o++)
+        {
+            for(int s=0; s<(int)solverList.size(); s++)
+            {
+                fprintf(stderr, "grid %d, P%d, %s\n", gridList[g], orderList[o], solverList[s]->name);
+                RunModel(gridList[g], orderList[o], *solverList[s], variant, adaptCycles, results);
+            }
+        }
+    }
+
+    if(strcmp(format, "json") == 0)
+        WriteJSON(out, results);
+    else
+        WriteCSV(out, results);
+
+    if(output)
+        fclose(out);
+
+    return 0;
+}
@@ -15,11 +15,14 @@
  *
  *******************************************************************/
 
-#include "GL/glut.h"  
+#include <assert.h>
 #include <math.h>
 #include <stdio.h>
+#include <string>
 
-#include "HSV2RGB.h"
+#include "BinaryCache.h"
+#include "MeshIO.h"
+#include "NodeOrdering.h"
 #include "FEModel.h"
 
 /*----------------------------------------------------------------*/
@@ -38,11 +41,15 @@ void FEModel::CreateUniformGridMesh(int nodesX, int nodesY) {
 	double lenX = (double) (nodesX - 1);
 	double lenY = (double) (nodesY - 1);
 
+	mesh.Clear();
+	mesh.Reserve(nodesX * nodesY, 2 * (nodesX - 1) * (nodesY - 1));
+
 	for (int y = 0; y < nodesY; y++) {
 		for (int x = 0; x < nodesX; x++) {
 			Vector2 pos = Vector2((double) x / lenX, (double) y / lenY);
-			nodes.push_back(pos);
-			num_nodes++;
+			bool boundary = (x == 0 || y == 0 || x == nodesX - 1
+					|| y == nodesY - 1);
+			mesh.AddNode(pos, boundary ? 1 : 0);
 		}
 	}
 
@@ -53,30 +60,584 @@ void FEModel::CreateUniformGridMesh(int nodesX, int nodesY) {
 			int node01 = node00 + nodesX;
 			int node11 = node00 + nodesX + 1;
 
-			elements.push_back(LinTriElement(node00, node10, node11));
-			elements.push_back(LinTriElement(node00, node11, node01));
-			num_elems += 2;
+			mesh.AddTriangle(node00, node10, node11);
+			mesh.AddTriangle(node00, node11, node01);
 		}
 	}
 
+	mesh.UpdateGeometry();
+	InitializeMesh();
+
+	/* Edge nodes do not fit the grid numbering */
+	if (elementOrder == 1) {
+		grid_nodesX = nodesX;
+		grid_nodesY = nodesY;
+	}
+}
+
+/* Reads a mesh from a Gmsh .msh file (format 4.1, ASCII or binary) or from
+ Triangle's .node/.ele(/.poly) files, given by the name of any of them or
+ their common base name. Nodes marked as boundary in the file receive the
+ Dirichlet conditions of SetBoundaryConditions. */
+bool FEModel::LoadMesh(const char *filename) {
+	std::string name(filename);
+	std::string ext;
+
+	size_t dot = name.rfind('.');
+	if (dot != std::string::npos && name.find('/', dot) == std::string::npos)
+		ext = name.substr(dot);
+
+	bool ok;
+	if (ext == ".msh")
+		ok = ReadGmshMesh(filename, mesh);
+	else if (ext == ".node" || ext == ".ele" || ext == ".poly")
+		ok = ReadTriangleMesh(name.substr(0, dot).c_str(), mesh);
+	else
+		ok = ReadTriangleMesh(filename, mesh);
+
+	if (!ok) {
+		mesh.Clear();
+		InitializeMesh();
+		return false;
+	}
+
+	InitializeMesh();
+	return true;
+}
+
+/* Adds the edge and interior nodes of Lagrange elements of the given order to
+ the mesh and fills the element node table. Nodes on an edge are numbered from
+ its smaller vertex ID, so both adjacent elements agree on them. A node on a
+ boundary edge between two marked vertices gets the marker of the first. */
+template<int ORDER>
+static void AddLagrangeNodes(TriangleMesh &mesh, vector<int32_t> &elemNodes) {
+	typedef LagrangeTriangleT<ORDER> Element;
+	const int perEdge = Element::NODES_PER_EDGE;
+
+	vector<int32_t> edgeNodes, edgeElements, elementEdges;
+	mesh.BuildEdges(edgeNodes, edgeElements, elementEdges);
+
+	int numEdges = (int) edgeNodes.size() / 2;
+	int firstEdgeNode = mesh.GetNumNodes();
+
+	for (int edge = 0; edge < numEdges; edge++) {
+		int a = edgeNodes[2 * edge];
+		int b = edgeNodes[2 * edge + 1];
+
+		bool boundary = (edgeElements[2 * edge + 1] < 0);
+		int marker = (boundary && mesh.GetNodeMarker(a) != 0
+				&& mesh.GetNodeMarker(b) != 0) ? mesh.GetNodeMarker(a) : 0;
+
+		for (int s = 1; s <= perEdge; s++) {
+			Vector2 pos = mesh.GetNode(a) * ((double) (ORDER - s) / ORDER)
+					+ mesh.GetNode(b) * ((double) s / ORDER);
+			mesh.AddNode(pos, marker);
+		}
+	}
+
+	int numElems = mesh.GetNumTriangles();
+	elemNodes.resize(Element::NUM_NODES * numElems);
+
+	for (int e = 0; e < numElems; e++) {
+		TriangleMesh::Element element = mesh.GetElement(e);
+		int32_t *nodes = &elemNodes[Element::NUM_NODES * e];
+
+		for (int a = 0; a < 3; a++) {
+			nodes[a] = element.GetNode(a);
+
+			int first = firstEdgeNode + perEdge * elementEdges[3 * e + a];
+			bool forward = element.GetNode(a) < element.GetNode((a + 1) % 3);
+			for (int s = 1; s <= perEdge; s++)
+				nodes[3 + perEdge * a + s - 1] = first
+						+ (forward ? s - 1 : perEdge - s);
+		}
+
+		for (int a = 3 + 3 * perEdge; a < Element::NUM_NODES; a++) {
+			int index[3];
+			Element::GetNodeIndex(a, index);
+
+			Vector2 pos(0.0, 0.0);
+			for (int m = 0; m < 3; m++)
+				pos += element.GetNodePosition(m) * ((double) index[m] / ORDER);
+			nodes[a] = mesh.AddNode(pos, 0);
+		}
+	}
+}
+
+/* Resets all per-node and per-element state after the mesh was replaced */
+void FEModel::InitializeMesh() {
+	elemNodes.clear();
+	if (elementOrder == 2)
+		AddLagrangeNodes<2>(mesh, elemNodes);
+
+	num_nodes = mesh.GetNumNodes();
+	num_elems = mesh.GetNumTriangles();
+	grid_nodesX = grid_nodesY = 0;
+
+	nodePerm.resize(num_nodes);
+	for (int i = 0; i < num_nodes; i++)
+		nodePerm[i] = i;
+
 	solution.resize(num_nodes);
 	error.resize(num_nodes);
 	abserror.resize(num_nodes);
 	rhs.resize(num_nodes);
 
+	boundaryConds.clear();
+
+	K_matrix.ClearResize(num_nodes);
+	K_patternValid = false;
+	coloringValid = false;
+	rhsSource = NULL;
+}
+
+/* Renumbers nodes for better locality in the sparse matrix operations.
+ Elements, boundary conditions, the rhs and the solution are remapped; the
+ original numbering stays available through GetOriginalNodeID/GetSolution.
+ Must be called before the stiffness matrix is assembled. */
+void FEModel::RenumberNodes(NodeOrdering ordering) {
+	vector<int> perm; /* perm[new] = old */
+
+	if (ordering == ORDER_MORTON) {
+		MortonOrdering(mesh.GetNodes(), perm);
+	} else {
+		/* Node graph from element connectivity */
+		const int *conn = GetElementNodes();
+		int n = GetNodesPerElement();
+		vector<vector<int> > nbrs(num_nodes);
+		for (int e = 0; e < num_elems; e++)
+			for (int a = 0; a < n; a++)
+				for (int b = 0; b < n; b++)
+					if (a != b)
+						nbrs[conn[n * e + a]].push_back(conn[n * e + b]);
+
+		vector<int> adjPtr(num_nodes + 1, 0);
+		vector<int> adj;
+		for (int i = 0; i < num_nodes; i++) {
+			std::sort(nbrs[i].begin(), nbrs[i].end());
+			nbrs[i].erase(std::unique(nbrs[i].begin(), nbrs[i].end()),
+					nbrs[i].end());
+			adj.insert(adj.end(), nbrs[i].begin(), nbrs[i].end());
+			adjPtr[i + 1] = (int) adj.size();
+		}
+
+		ReverseCuthillMcKee(adjPtr, adj, perm);
+	}
+
+	vector<int> inv(num_nodes);
+	for (int i = 0; i < num_nodes; i++)
+		inv[perm[i]] = i;
+
+	vector<double> oldSolution = solution;
+	vector<double> oldRhs = rhs;
+	vector<int> oldPerm = nodePerm;
+	for (int i = 0; i < num_nodes; i++) {
+		solution[i] = oldSolution[perm[i]];
+		rhs[i] = oldRhs[perm[i]];
+		nodePerm[i] = oldPerm[perm[i]];
+	}
+
+	/* Areas and gradients only depend on the element, not on node IDs */
+	mesh.PermuteNodes(perm);
+	for (int k = 0; k < (int) elemNodes.size(); k++)
+		elemNodes[k] = inv[elemNodes[k]];
+
+	for (int i = 0; i < (int) boundaryConds.size(); i++)
+		boundaryConds[i] = BoundaryCondition(inv[boundaryConds[i].GetID()],
+				boundaryConds[i].GetValue());
+
+	/* The grid structure no longer matches the numbering */
+	grid_nodesX = grid_nodesY = 0;
+
 	K_matrix.ClearResize(num_nodes);
+	K_patternValid = false;
+}
+
+void FEModel::GetSolution(vector<double> &values) const {
+	values.resize(num_nodes);
+	for (int i = 0; i < num_nodes; i++)
+		values[nodePerm[i]] = solution[i];
+}
+
+/*----------------------------------------------------------------*/
+/* Sections of the system cache files (see BinaryCache.h). The version
+ must be increased whenever the layout or the built-in source and boundary
+ functions change. */
+enum SystemCacheSection {
+	CACHE_PARAMS = 1, /* Quadrature degree, grid nodes x and y */
+	CACHE_NODES,
+	CACHE_MARKERS,
+	CACHE_TRIANGLES,
+	CACHE_NODE_PERM,
+	CACHE_K_ROW_PTR,
+	CACHE_K_COL_IDX,
+	CACHE_K_VALUES,
+	CACHE_RHS,
+	CACHE_BC_NODES,
+	CACHE_BC_VALUES,
+	CACHE_SOLUTION
+};
+
+static const char *SYSTEM_CACHE_MAGIC = "FEMSYS";
+static const uint32_t SYSTEM_CACHE_VERSION = 1;
+
+/* Identifies the system the current mesh and settings produce */
+uint64_t FEModel::ComputeSystemKey() const {
+	int32_t params[3] = { quadratureDegree, grid_nodesX, grid_nodesY };
+
+	uint64_t key = HashBytes(&SYSTEM_CACHE_VERSION,
+			sizeof(SYSTEM_CACHE_VERSION));
+	key = HashBytes(params, sizeof(params), key);
+	key = HashArray(mesh.GetNodes(), key);
+	key = HashArray(mesh.GetNodeMarkers(), key);
+	key = HashBytes(mesh.GetConnectivity(), 3 * num_elems * sizeof(int32_t),
+			key);
+	key = HashArray(nodePerm, key);
+
+	return key;
+}
+
+/* Writes mesh, assembled stiffness matrix, right-hand side, boundary
+ conditions and solution. Needs the assembled matrix. */
+bool FEModel::SaveSystem(const char *filename) const {
+	if (matrixFree || elementOrder != 1 || !K_matrix.IsFinalized())
+		return false;
+
+	int32_t params[3] = { quadratureDegree, grid_nodesX, grid_nodesY };
+
+	vector<int> bcNodes(boundaryConds.size());
+	vector<double> bcValues(boundaryConds.size());
+	for (int i = 0; i < (int) boundaryConds.size(); i++) {
+		bcNodes[i] = boundaryConds[i].GetID();
+		bcValues[i] = boundaryConds[i].GetValue();
+	}
+
+	BinaryCacheWriter writer(SYSTEM_CACHE_MAGIC, SYSTEM_CACHE_VERSION,
+			ComputeSystemKey());
+	writer.AddSection(CACHE_PARAMS, params, sizeof(int32_t), 3);
+	writer.AddSection(CACHE_NODES, mesh.GetNodes());
+	writer.AddSection(CACHE_MARKERS, mesh.GetNodeMarkers());
+	writer.AddSection(CACHE_TRIANGLES, mesh.GetConnectivity(),
+			sizeof(int32_t), 3 * num_elems);
+	writer.AddSection(CACHE_NODE_PERM, nodePerm);
+	writer.AddSection(CACHE_K_ROW_PTR, K_matrix.GetRowPtr());
+	writer.AddSection(CACHE_K_COL_IDX, K_matrix.GetColIdx());
+	writer.AddSection(CACHE_K_VALUES, K_matrix.GetValues());
+	writer.AddSection(CACHE_RHS, rhs);
+	writer.AddSection(CACHE_BC_NODES, bcNodes);
+	writer.AddSection(CACHE_BC_VALUES, bcValues);
+	writer.AddSection(CACHE_SOLUTION, solution);
+
+	return writer.Write(filename);
+}
+
+/* Restores a system written by SaveSystem, replacing assembly, ComputeRHS
+ and SetBoundaryConditions; the cached solution is the initial guess of
+ the next Solve. If a mesh is set, the file must have been written for the
+ same mesh and settings; otherwise mesh and settings are taken from the
+ file. Returns false (and leaves the model unchanged) if the file is
+ missing, of another version, stale or inconsistent. */
+bool FEModel::LoadSystem(const char *filename) {
+	if (matrixFree || elementOrder != 1)
+		return false;
+
+	BinaryCacheReader reader;
+	if (!reader.Open(filename, SYSTEM_CACHE_MAGIC, SYSTEM_CACHE_VERSION))
+		return false;
+
+	size_t numParams = 0, numNodes = 0, numConn = 0, numMarkers = 0;
+	const int32_t *params = reader.GetSection<int32_t>(CACHE_PARAMS,
+			numParams);
+	const Vector2 *nodes = reader.GetSection<Vector2>(CACHE_NODES, numNodes);
+	const int32_t *markers = reader.GetSection<int32_t>(CACHE_MARKERS,
+			numMarkers);
+	const int32_t *conn = reader.GetSection<int32_t>(CACHE_TRIANGLES,
+			numConn);
+
+	if (!params || numParams != 3 || !nodes || !markers
+			|| numMarkers != numNodes || !conn || numConn % 3 != 0
+			|| numNodes > INT32_MAX || numConn > INT32_MAX)
+		return false;
+
+	bool restoreMesh = (num_nodes == 0);
+	if (!restoreMesh && reader.GetKey() != ComputeSystemKey())
+		return false;
+
+	int n = (int) numNodes;
+	for (size_t k = 0; k < numConn && restoreMesh; k++)
+		if (conn[k] < 0 || conn[k] >= n)
+			return false;
+
+	vector<int> perm, rowPtr, colIdx, bcNodes;
+	vector<double> values, newRhs, bcValues, newSolution;
+
+	size_t nnz = 0, numBCs = 0;
+	reader.GetSection<int>(CACHE_K_COL_IDX, nnz);
+	reader.GetSection<int>(CACHE_BC_NODES, numBCs);
+
+	if (!reader.ReadSection(CACHE_NODE_PERM, n, perm)
+			|| !reader.ReadSection(CACHE_K_ROW_PTR, n + 1, rowPtr)
+			|| !reader.ReadSection(CACHE_K_COL_IDX, nnz, colIdx)
+			|| !reader.ReadSection(CACHE_K_VALUES, nnz, values)
+			|| !reader.ReadSection(CACHE_RHS, n, newRhs)
+			|| !reader.ReadSection(CACHE_BC_NODES, numBCs, bcNodes)
+			|| !reader.ReadSection(CACHE_BC_VALUES, numBCs, bcValues)
+			|| !reader.ReadSection(CACHE_SOLUTION, n, newSolution))
+		return false;
+
+	/* Lower triangular CSR with ascending columns */
+	if (rowPtr[0] != 0 || rowPtr[n] != (int) nnz)
+		return false;
+	for (int row = 0; row < n; row++) {
+		if (rowPtr[row + 1] < rowPtr[row])
+			return false;
+		for (int k = rowPtr[row]; k < rowPtr[row + 1]; k++)
+			if (colIdx[k] < 0 || colIdx[k] > row
+					|| (k > rowPtr[row] && colIdx[k] <= colIdx[k - 1]))
+				return false;
+	}
+	for (int i = 0; i < (int) numBCs; i++)
+		if (bcNodes[i] < 0 || bcNodes[i] >= n)
+			return false;
+	for (int i = 0; i < n && restoreMesh; i++)
+		if (perm[i] < 0 || perm[i] >= n)
+			return false;
+
+	if (restoreMesh) {
+		mesh.Clear();
+		mesh.Reserve(n, (int) numConn / 3);
+		for (int i = 0; i < n; i++)
+			mesh.AddNode(nodes[i], markers[i]);
+		for (size_t k = 0; k < numConn; k += 3)
+			mesh.AddTriangle(conn[k], conn[k + 1], conn[k + 2]);
+		mesh.UpdateGeometry();
+		InitializeMesh();
+
+		quadratureDegree = params[0];
+		grid_nodesX = params[1];
+		grid_nodesY = params[2];
+		nodePerm.swap(perm);
+	}
+
+	K_matrix.SetCSR(n, rowPtr, colIdx, values);
+	rhs.swap(newRhs);
+	rhsSource = Source_Term_f;
+	solution.swap(newSolution);
+
+	boundaryConds.clear();
+	for (int i = 0; i < (int) numBCs; i++)
+		boundaryConds.push_back(BoundaryCondition(bcNodes[i], bcValues[i]));
+
+	/* The element scatter offsets are not cached */
+	K_patternValid = false;
+	return true;
+}
+
+/* Element schedule shared by stiffness and load vector assembly */
+void FEModel::ColorElements() {
+	elemColoring.Compute(mesh.GetConnectivity(), num_elems, 3, num_nodes);
+	coloringValid = true;
+}
+
+/* Symbolic phase: colors the elements, discovers the sparsity pattern by a
+ full triplet assembly and records for every element where its local entries
+ live in the value array of K_matrix. Only needs to be redone when the mesh
+ changes. */
+void FEModel::BuildStiffnessPattern() {
+	if (!coloringValid)
+		ColorElements();
+
+	if (elementOrder == 2) {
+		BuildLagrangePattern<2>();
+		return;
+	}
+
+	/* Every element contributes 6 lower-triangular entries. Elements are
+	 visited in color order, the same order the numeric phase sums in. */
+	K_triplets.Reset(num_nodes, 6 * num_elems);
+
+	for (int k = 0; k < num_elems; k++) {
+		TriangleMesh::Element e = mesh.GetElement(elemColoring.GetElement(k));
+
+		double stiffness[6];
+		e.ComputeStiffness(stiffness);
+
+		for (int j = 0; j < 6; j++) {
+			int a = e.GetNode(TriangleMesh::GetStiffnessPair(j, 0));
+			int b = e.GetNode(TriangleMesh::GetStiffnessPair(j, 1));
+			K_triplets.Add(std::max(a, b), std::min(a, b), stiffness[j]);
+		}
+	}
+
+	/* Sort, sum duplicates and store in compressed-row form */
+	K_triplets.BuildMatrix(K_matrix);
+
+	K_scatter.resize(6 * num_elems);
+	for (TriangleMesh::ElementIterator e = mesh.begin(); e != mesh.end(); ++e) {
+		for (int k = 0; k < 6; k++) {
+			int i = e->GetNode(TriangleMesh::GetStiffnessPair(k, 0));
+			int j = e->GetNode(TriangleMesh::GetStiffnessPair(k, 1));
+
+			K_scatter[6 * e->GetIndex() + k] = K_matrix.FindOffset(
+					std::max(i, j), std::min(i, j));
+		}
+	}
+
+	K_patternValid = true;
+}
+
+/* Stiffness matrix of mesh element e from the tables of a Lagrange element */
+template<class Element>
+static void LagrangeStiffness(const Element &element,
+		const TriangleMesh::Element &e, double *stiffness) {
+	double gradX[3], gradY[3];
+	for (int a = 0; a < 3; a++) {
+		Vector2 grad = e.GetGradient(a);
+		gradX[a] = grad[0];
+		gradY[a] = grad[1];
+	}
+
+	element.ComputeStiffness(e.GetArea(), gradX, gradY, stiffness);
+}
+
+/* Same for Lagrange elements of higher order, with the element matrices from
+ the reference tables of LagrangeTriangleT */
+template<int ORDER>
+void FEModel::BuildLagrangePattern() {
+	typedef LagrangeTriangleT<ORDER> Element;
+	const int numPairs = Element::NUM_PAIRS;
+
+	Element element(quadratureDegree);
+	K_triplets.Reset(num_nodes, numPairs * num_elems);
+
+	for (int k = 0; k < num_elems; k++) {
+		int e = elemColoring.GetElement(k);
+		const int32_t *nodes = &elemNodes[Element::NUM_NODES * e];
+
+		double stiffness[numPairs];
+		LagrangeStiffness(element, mesh.GetElement(e), stiffness);
+
+		for (int p = 0; p < numPairs; p++) {
+			int a, b;
+			Element::GetPair(p, a, b);
+			K_triplets.Add(std::max(nodes[a], nodes[b]),
+					std::min(nodes[a], nodes[b]), stiffness[p]);
+		}
+	}
+
+	K_triplets.BuildMatrix(K_matrix);
+
+	K_scatter.resize(numPairs * num_elems);
+	for (int e = 0; e < num_elems; e++) {
+		const int32_t *nodes = &elemNodes[Element::NUM_NODES * e];
+
+		for (int p = 0; p < numPairs; p++) {
+			int a, b;
+			Element::GetPair(p, a, b);
+			K_scatter[numPairs * e + p] = K_matrix.FindOffset(
+					std::max(nodes[a], nodes[b]), std::min(nodes[a], nodes[b]));
+		}
+	}
+
+	K_patternValid = true;
+}
+
+/* Numeric phase for Lagrange elements of higher order, see
+ AssembleStiffnessMatrix */
+template<int ORDER>
+void FEModel::AssembleLagrange() {
+	typedef LagrangeTriangleT<ORDER> Element;
+	const int numPairs = Element::NUM_PAIRS;
+
+	Element element(quadratureDegree);
+
+	vector<double> &values = K_matrix.GetValues();
+	std::fill(values.begin(), values.end(), 0.0);
+
+	for (int c = 0; c < elemColoring.GetNumColors(); c++) {
+		int begin = elemColoring.GetColorBegin(c);
+		int end = elemColoring.GetColorEnd(c);
+
+#pragma omp parallel for schedule(static)
+		for (int k = begin; k < end; k++) {
+			int e = elemColoring.GetElement(k);
+
+			double stiffness[numPairs];
+			LagrangeStiffness(element, mesh.GetElement(e), stiffness);
+
+			const int *offsets = &K_scatter[numPairs * e];
+			for (int p = 0; p < numPairs; p++)
+				values[offsets[p]] += stiffness[p];
+		}
+	}
+}
+
+/* Expands the 6 entries of Element::ComputeStiffness to a 3x3 matrix */
+static void ElementStiffnessMatrix(const TriangleMesh::Element &element,
+		double k[3][3]) {
+	double stiffness[6];
+	element.ComputeStiffness(stiffness);
+
+	for (int j = 0; j < 6; j++) {
+		int a = TriangleMesh::GetStiffnessPair(j, 0);
+		int b = TriangleMesh::GetStiffnessPair(j, 1);
+		k[a][b] = k[b][a] = stiffness[j];
+	}
 }
 
 void FEModel::AssembleStiffnessMatrix() {
-	for (int i = 0; i < num_elems; i++)
-		elements[i].AssembleElement(this);
+	if (IsMatrixFree()) {
+		/* All cells of the uniform grid are congruent: the two triangles of
+		 the first cell define the stencil */
+		double kLower[3][3], kUpper[3][3];
+		ElementStiffnessMatrix(mesh.GetElement(0), kLower);
+		ElementStiffnessMatrix(mesh.GetElement(1), kUpper);
+
+		K_operator.Setup(grid_nodesX, grid_nodesY, kLower, kUpper);
+		return;
+	}
+
+	if (!K_patternValid) {
+		/* The symbolic phase assembles the values as well */
+		BuildStiffnessPattern();
+		return;
+	}
+
+	if (elementOrder == 2) {
+		AssembleLagrange<2>();
+		return;
+	}
+
+	/* Numeric phase: scatter element matrices into the cached pattern. Elements
+	 of one color share no node, so each color class runs in parallel; the
+	 classes themselves are processed in order, which keeps the summation
+	 order (and the result) independent of the number of threads. */
+	vector<double> &values = K_matrix.GetValues();
+	std::fill(values.begin(), values.end(), 0.0);
+
+	for (int c = 0; c < elemColoring.GetNumColors(); c++) {
+		int begin = elemColoring.GetColorBegin(c);
+		int end = elemColoring.GetColorEnd(c);
+
+#pragma omp parallel for schedule(static)
+		for (int k = begin; k < end; k++) {
+			int e = elemColoring.GetElement(k);
+
+			double stiffness[6];
+			mesh.GetElement(e).ComputeStiffness(stiffness);
+
+			const int *offsets = &K_scatter[6 * e];
+			for (int j = 0; j < 6; j++)
+				values[offsets[j]] += stiffness[j];
+		}
+	}
 }
 
 void FEModel::SetBoundaryConditions() {
 	for (int i = 0; i < num_nodes; i++) {
 		const Vector2 &pos = GetNodePosition(i);
 
-		if (pos[0] <= 0.0 || pos[0] >= 1.0 || pos[1] <= 0.0 || pos[1] >= 1.0) {
+		if (mesh.GetNodeMarker(i) != 0) {
 			double x = pos[0];
 			double y = pos[1];
 
@@ -91,43 +652,328 @@ void FEModel::SetBoundaryConditions() {
 void FEModel::ComputeRHS() {
 	// task 3
 
-	//what we need to do is:
-	// - initialize rhs with zeroes
-	// - for every node n_j, check every triangle e if it contains n_j
-	// - if it does, add A_e * f(c_e.x(), c_e.y()) * N_j(c_e.x(), c_e.y())
-
-	//In theory N_j is only dependent on n_j (it is it's basis function)
-	//but in this practical case, the element (triangle) we are in determines
-	//where to find the correct PART of the basis function (ie. the one for the barycenter of e).
-	//This part of the basis function needed for e is conveniently saved in e.
-	for (unsigned int i = 0; i < rhs.size(); i++)
-		rhs[i] = 0;
-
-	for (unsigned int j = 0; j < nodes.size(); j++) {
-		for (LinTriElement e : elements) {
-			if (e.contains(j)) {
-				Vector2 center = e.GetCenter(this);
-				rhs[j] += Source_Term_f(center.x(), center.y())
-						* e.GetArea(this) * e.evaluateN(this, j);
-			}
+	//rhs_j = sum over the triangles e around node j of the integral of f * N_j
+	// over e, evaluated with the selected Gauss rule (see ComputeLoadVector)
+	ComputeRHS(Source_Term_f);
+}
+
+void FEModel::ComputeRHS(ScalarFunction source) {
+	ComputeLoadVector(source, rhs);
+	rhsSource = source;
+}
+
+void FEModel::SetBoundaryValues(ScalarFunction boundary) {
+	for (int i = 0; i < (int) boundaryConds.size(); i++) {
+		int id = boundaryConds[i].GetID();
+		const Vector2 &pos = GetNodePosition(id);
+		boundaryConds[i] = BoundaryCondition(id, boundary(pos[0], pos[1]));
+	}
+}
+
+/* Integrals of source * N_j over the triangle (p0, p1, p2), divided by its
+ area */
+static void ElementLoad(const TriangleQuadrature &rule, ScalarFunction source,
+		const Vector2 &p0, const Vector2 &p1, const Vector2 &p2,
+		double contrib[3]) {
+	contrib[0] = contrib[1] = contrib[2] = 0.0;
+	for (int q = 0; q < rule.numPoints; q++) {
+		const double *l = rule.points[q];
+		double x = l[0] * p0[0] + l[1] * p1[0] + l[2] * p2[0];
+		double y = l[0] * p0[1] + l[1] * p1[1] + l[2] * p2[1];
+
+		double fw = rule.weights[q] * source(x, y);
+		for (int j = 0; j < 3; j++)
+			contrib[j] += fw * l[j];
+	}
+}
+
+/* Right-hand side for an arbitrary source term. Every element is visited
+ once and adds its contributions to its three nodes; within an element
+ N_j equals the barycentric coordinate of node j, so the quadrature
+ points directly provide the basis function values. Elements run in
+ parallel per color class, like the stiffness assembly. */
+void FEModel::ComputeLoadVector(ScalarFunction source, vector<double> &load) {
+	load.assign(num_nodes, 0.0);
+
+	if (!coloringValid)
+		ColorElements();
+
+	if (elementOrder == 2) {
+		ComputeLagrangeLoad<2>(source, load);
+		return;
+	}
+
+	TriangleQuadrature rule = GetTriangleQuadrature(quadratureDegree);
+
+	for (int c = 0; c < elemColoring.GetNumColors(); c++) {
+		int begin = elemColoring.GetColorBegin(c);
+		int end = elemColoring.GetColorEnd(c);
+
+#pragma omp parallel for schedule(static)
+		for (int k = begin; k < end; k++) {
+			TriangleMesh::Element e = mesh.GetElement(elemColoring.GetElement(k));
+
+			double contrib[3];
+			ElementLoad(rule, source, e.GetNodePosition(0),
+					e.GetNodePosition(1), e.GetNodePosition(2), contrib);
+
+			for (int j = 0; j < 3; j++)
+				load[e.GetNode(j)] += e.GetArea() * contrib[j];
 		}
 	}
 }
 
+/* Load vector for Lagrange elements of higher order. The Gauss rule has at
+ least degree 2 * ORDER, so that the quadrature does not limit the order of
+ convergence. */
+template<int ORDER>
+void FEModel::ComputeLagrangeLoad(ScalarFunction source, vector<double> &load) {
+	typedef LagrangeTriangleT<ORDER> Element;
+
+	Element element(std::min(std::max(quadratureDegree, 2 * ORDER),
+			TRIANGLE_QUADRATURE_MAX_DEGREE));
+
+	for (int c = 0; c < elemColoring.GetNumColors(); c++) {
+		int begin = elemColoring.GetColorBegin(c);
+		int end = elemColoring.GetColorEnd(c);
+
+#pragma omp parallel for schedule(static)
+		for (int k = begin; k < end; k++) {
+			int e = elemColoring.GetElement(k);
+			TriangleMesh::Element t = mesh.GetElement(e);
+			const int32_t *nodes = &elemNodes[Element::NUM_NODES * e];
+
+			double contrib[Element::NUM_NODES];
+			element.ComputeLoad(source, t.GetNodePosition(0),
+					t.GetNodePosition(1), t.GetNodePosition(2), contrib);
+
+			for (int a = 0; a < Element::NUM_NODES; a++)
+				load[nodes[a]] += t.GetArea() * contrib[a];
+		}
+	}
+}
+
+/* Rebuilds K_reduced and the boundary mask unless they were built from
+ the current K_matrix (same generation) and the same boundary nodes, and
+ gathers the current boundary values */
+void FEModel::UpdateReducedSystem() {
+	vector<char> mask(num_nodes, 0);
+	for (int i = 0; i < (int) boundaryConds.size(); i++)
+		mask[boundaryConds[i].GetID()] = 1;
+
+	K_matrix.Finalize();
+	if (mask != boundaryMask || K_matrix.GetGeneration() != reducedGeneration) {
+		boundaryMask.swap(mask);
+
+		/* Assigning reuses the storage of the previous copy */
+		K_reduced = K_matrix;
+		K_reduced.FixMatrix(boundaryMask);
+		reducedGeneration = K_matrix.GetGeneration();
+	}
+
+	boundaryValues.assign(num_nodes, 0.0);
+	for (int i = 0; i < (int) boundaryConds.size(); i++)
+		boundaryValues[boundaryConds[i].GetID()] = boundaryConds[i].GetValue();
+}
+
 void FEModel::Solve() {
-	vector<double> tmp_rhs = rhs;
-	SparseSymmetricMatrix tmp_K_matrix = K_matrix;
+	if (IsMatrixFree()) {
+		/* Same system as FixSolution produces: boundary rows become identity,
+		 known values are moved to the right-hand side */
+		vector<char> mask(num_nodes, 0);
+		vector<double> g(num_nodes, 0.0);
+		for (int i = 0; i < (int) boundaryConds.size(); i++) {
+			mask[boundaryConds[i].GetID()] = 1;
+			g[boundaryConds[i].GetID()] = boundaryConds[i].GetValue();
+		}
+
+		vector<double> tmp_rhs(num_nodes);
+		K_operator.MultVectorUnmasked(g, tmp_rhs);
+		for (int i = 0; i < num_nodes; i++)
+			tmp_rhs[i] = mask[i] ? g[i] : rhs[i] - tmp_rhs[i];
+
+		for (int i = 0; i < num_nodes; i++)
+			if (mask[i])
+				solution[i] = g[i];
+
+		K_operator.SetMask(mask);
+
+		SparseLinSolverPCGT<double> solver;
+		solver.SetVariant(pcgVariant);
+		solverStats = solver.SolveLinearSystem(K_operator, solution, tmp_rhs,
+				(double) 1e-6, 1000);
 
-	/* Adjust K matrix to accommodate for known values of u on boundary */
+		K_operator.ClearMask();
+		return;
+	}
+
+	/* Adjust K matrix to accommodate for known values of u on boundary:
+	 the decoupled matrix is cached, the known values are moved to the
+	 right-hand side in one pass over the original matrix */
+	UpdateReducedSystem();
+	K_matrix.FixRHS(rhs, boundaryMask, boundaryValues, reducedRhs);
+
+	/* Warm start; the boundary rows are satisfied from the beginning */
 	for (int i = 0; i < (int) boundaryConds.size(); i++)
-		tmp_K_matrix.FixSolution(tmp_rhs, boundaryConds[i].GetID(),
-				boundaryConds[i].GetValue());
+		solution[boundaryConds[i].GetID()] = boundaryConds[i].GetValue();
+
+	SparseSymmetricMatrix &tmp_K_matrix = K_reduced;
+	vector<double> &tmp_rhs = reducedRhs;
+	PreconditionerType precond = GetActivePreconditioner();
 
-	SparseLinSolverPCGT<double> solver;
+	if (solverType == SOLVER_DIRECT) {
+		SolverTimer timer;
+		solverStats.Reset();
+
+		/* Factorization is kept while K_reduced is unchanged */
+		bool factorized = directSolver.IsFactorized(tmp_K_matrix);
+		if (!factorized) {
+			directSolver.Analyze(tmp_K_matrix);
+			factorized = directSolver.Factorize(tmp_K_matrix);
+		}
+		solverStats.timeSetup = timer.Lap();
+
+		/* A zero pivot leaves the solution untouched */
+		if (factorized)
+			directSolver.Solve(tmp_rhs, solution);
+		solverStats.timePrecond = timer.Lap();
+		solverStats.timeTotal = solverStats.timeSetup + solverStats.timePrecond;
+		solverStats.converged = factorized;
+	}
+	/* Float PCG corrections, refined in double to the same residual; the
+	 iteration limit applies to all corrections together */
+	else if (mixedPrecision) {
+		if (precond == PRECOND_IC0) {
+			mixedIC0.GetInnerSolver().SetVariant(pcgVariant);
+			solverStats = mixedIC0.SolveLinearSystem(tmp_K_matrix, solution,
+					tmp_rhs, (double) 1e-6, 1000);
+		} else if (precond == PRECOND_AMG) {
+			mixedAMG.GetInnerSolver().SetVariant(pcgVariant);
+			solverStats = mixedAMG.SolveLinearSystem(tmp_K_matrix, solution,
+					tmp_rhs, (double) 1e-6, 1000);
+		} else if (precond == PRECOND_GMG) {
+			mixedGMG.GetInnerSolver().SetVariant(pcgVariant);
+			mixedGMG.GetInnerSolver().GetPreconditioner().SetGrid(grid_nodesX,
+					grid_nodesY);
+			solverStats = mixedGMG.SolveLinearSystem(tmp_K_matrix, solution,
+					tmp_rhs, (double) 1e-6, 1000);
+		} else {
+			mixedJacobi.GetInnerSolver().SetVariant(pcgVariant);
+			solverStats = mixedJacobi.SolveLinearSystem(tmp_K_matrix, solution,
+					tmp_rhs, (double) 1e-6, 1000);
+		}
+	}
 	/* Use preconditioned conjugate gradient solver, with residual 1e-6, and
 	 maximum number of iterations 1000 */
-	solver.SolveLinearSystem(tmp_K_matrix, solution, tmp_rhs, (double) 1e-6,
-			1000);
+	else if (precond == PRECOND_IC0) {
+		SparseLinSolverPCGT<double, IncompleteCholeskyPreconditionerT<double> > solver;
+		solver.SetVariant(pcgVariant);
+		solverStats = solver.SolveLinearSystem(tmp_K_matrix, solution,
+				tmp_rhs, (double) 1e-6, 1000);
+	} else if (precond == PRECOND_AMG) {
+		amgSolver.SetVariant(pcgVariant);
+		solverStats = amgSolver.SolveLinearSystem(tmp_K_matrix, solution,
+				tmp_rhs, (double) 1e-6, 1000);
+	} else if (precond == PRECOND_GMG) {
+		SparseLinSolverPCGT<double, GeometricMultigridT<double> > solver;
+		solver.SetVariant(pcgVariant);
+		solver.GetPreconditioner().SetGrid(grid_nodesX, grid_nodesY);
+		solverStats = solver.SolveLinearSystem(tmp_K_matrix, solution,
+				tmp_rhs, (double) 1e-6, 1000);
+	} else {
+		SparseLinSolverPCGT<double> solver;
+		solver.SetVariant(pcgVariant);
+		solverStats = solver.SolveLinearSystem(tmp_K_matrix, solution,
+				tmp_rhs, (double) 1e-6, 1000);
+	}
+}
+
+void FEModel::SolveMultiple(const vector<ScalarFunction> &sources,
+		const vector<ScalarFunction> &boundaries, vector<double> &solutions) {
+	assert(!IsMatrixFree() && sources.size() == boundaries.size());
+
+	int k = (int) sources.size();
+	vector<double> tmp_rhs(num_nodes * k);
+	vector<double> values(num_nodes * k, 0.0);
+	vector<double> load;
+
+	for (int v = 0; v < k; v++) {
+		ComputeLoadVector(sources[v], load);
+		for (int i = 0; i < num_nodes; i++)
+			tmp_rhs[i * k + v] = load[i];
+	}
+
+	/* Move the known boundary values to the right-hand sides; the matrix
+	 is modified like in Solve, with the values applied separately */
+	vector<double> known(num_nodes * k, 0.0);
+	for (int b = 0; b < (int) boundaryConds.size(); b++) {
+		int id = boundaryConds[b].GetID();
+		const Vector2 &pos = GetNodePosition(id);
+		for (int v = 0; v < k; v++)
+			known[id * k + v] = boundaries[v](pos[0], pos[1]);
+	}
+
+	K_matrix.Finalize();
+	K_matrix.MultMultiVector(known, values, k);
+	for (int i = 0; i < num_nodes * k; i++)
+		tmp_rhs[i] -= values[i];
+
+	/* Same decoupled matrix as in Solve */
+	UpdateReducedSystem();
+	SparseSymmetricMatrix &tmp_K_matrix = K_reduced;
+	for (int b = 0; b < (int) boundaryConds.size(); b++) {
+		int id = boundaryConds[b].GetID();
+		for (int v = 0; v < k; v++)
+			tmp_rhs[id * k + v] = known[id * k + v];
+	}
+
+	std::fill(values.begin(), values.end(), 0.0);
+
+	PreconditionerType precond = GetActivePreconditioner();
+	if (solverType == SOLVER_DIRECT) {
+		SolverTimer timer;
+		solverStats.Reset();
+
+		bool factorized = directSolver.IsFactorized(tmp_K_matrix);
+		if (!factorized) {
+			directSolver.Analyze(tmp_K_matrix);
+			factorized = directSolver.Factorize(tmp_K_matrix);
+		}
+		solverStats.timeSetup = timer.Lap();
+
+		vector<double> b(num_nodes), x(num_nodes);
+		for (int v = 0; v < k && factorized; v++) {
+			for (int i = 0; i < num_nodes; i++)
+				b[i] = tmp_rhs[i * k + v];
+			directSolver.Solve(b, x);
+			for (int i = 0; i < num_nodes; i++)
+				values[i * k + v] = x[i];
+		}
+		solverStats.timePrecond = timer.Lap();
+		solverStats.timeTotal = solverStats.timeSetup + solverStats.timePrecond;
+		solverStats.converged = factorized;
+	} else if (precond == PRECOND_IC0) {
+		SparseLinSolverPCGT<double, IncompleteCholeskyPreconditionerT<double> > solver;
+		solverStats = solver.SolveMultiple(tmp_K_matrix, values, tmp_rhs, k,
+				(double) 1e-6, 1000);
+	} else if (precond == PRECOND_AMG) {
+		solverStats = amgSolver.SolveMultiple(tmp_K_matrix, values, tmp_rhs, k,
+				(double) 1e-6, 1000);
+	} else if (precond == PRECOND_GMG) {
+		SparseLinSolverPCGT<double, GeometricMultigridT<double> > solver;
+		solver.GetPreconditioner().SetGrid(grid_nodesX, grid_nodesY);
+		solverStats = solver.SolveMultiple(tmp_K_matrix, values, tmp_rhs, k,
+				(double) 1e-6, 1000);
+	} else {
+		SparseLinSolverPCGT<double> solver;
+		solverStats = solver.SolveMultiple(tmp_K_matrix, values, tmp_rhs, k,
+				(double) 1e-6, 1000);
+	}
+
+	solutions.resize(num_nodes * k);
+	for (int i = 0; i < num_nodes; i++)
+		for (int v = 0; v < k; v++)
+			solutions[nodePerm[i] * k + v] = values[i * k + v];
 }
 
 double FEModel::ComputeError() {
@@ -142,86 +988,319 @@ double FEModel::ComputeError() {
 	for (int i = 0; i < num_nodes; i++)
 		abserror[i] = fabs(abserror[i]);
 
-	/* Compute inner product error norm:  err = sqrt(v*K*v) */
+	/* Compute inner product error norm:  err = sqrt(v*K*v), v the nodal error
+	 (for any element order, K couples all nodes of an element) */
 	//K*v
-	std::vector<double> kv(abserror.size());
-	K_matrix.MultVector(abserror, kv);
+	std::vector<double> kv(error.size());
+	if (IsMatrixFree())
+		K_operator.MultVectorUnmasked(error, kv);
+	else
+		K_matrix.MultVector(error, kv);
 
 	//v*(K*v)
 	for (unsigned i = 0; i < kv.size(); i++) {
-		err_nrm = abserror[i] * kv[i];
+		err_nrm += error[i] * kv[i];
 	}
-	err_nrm = sqrt(err_nrm);
+	err_nrm = sqrt(std::max(err_nrm, 0.0));
 
 	// Task 4
 	return err_nrm;
 }
 
-void FEModel::Render(int toggle_vis) {
-	vector<double> data;
+/* L2 norm of u - u_h, with u_h interpolated by the element shape functions */
+template<int ORDER>
+double FEModel::ComputeL2Error() const {
+	typedef LagrangeTriangleT<ORDER> Element;
+
+	Element element(TRIANGLE_QUADRATURE_MAX_DEGREE);
+	const TriangleQuadrature &rule = element.GetRule();
+	const int32_t *elementNodes = GetElementNodes();
+
+	double l2 = 0.0;
+
+#pragma omp parallel for schedule(static) reduction(+:l2)
+	for (int e = 0; e < num_elems; e++) {
+		TriangleMesh::Element t = mesh.GetElement(e);
+		const int32_t *nodes = &elementNodes[Element::NUM_NODES * e];
+
+		const Vector2 &p0 = t.GetNodePosition(0);
+		const Vector2 &p1 = t.GetNodePosition(1);
+		const Vector2 &p2 = t.GetNodePosition(2);
+
+		double sum = 0.0;
+		for (int q = 0; q < rule.numPoints; q++) {
+			const double *l = rule.points[q];
+			const double *N = element.GetShape(q);
+
+			double uh = 0.0;
+			for (int a = 0; a < Element::NUM_NODES; a++)
+				uh += N[a] * solution[nodes[a]];
+
+			double d = Boundary_u(l[0] * p0[0] + l[1] * p1[0] + l[2] * p2[0],
+					l[0] * p0[1] + l[1] * p1[1] + l[2] * p2[1]) - uh;
+			sum += rule.weights[q] * d * d;
+		}
+		l2 += t.GetArea() * sum;
+	}
+
+	return sqrt(l2);
+}
+
+void FEModel::ComputeErrorNorms(double &maxError, double &l2Error,
+		double &energyError) const {
+	vector<double> e(num_nodes);
+	maxError = 0.0;
+	for (int i = 0; i < num_nodes; i++) {
+		const Vector2 &pos = GetNodePosition(i);
+		e[i] = Boundary_u(pos[0], pos[1]) - solution[i];
+		maxError = std::max(maxError, fabs(e[i]));
+	}
+
+	if (elementOrder == 2)
+		l2Error = ComputeL2Error<2>();
+	else
+		l2Error = ComputeL2Error<1>();
 
-	/* Select data to display */
-	if (toggle_vis)
-		data = abserror;
+	vector<double> ke(num_nodes);
+	if (IsMatrixFree())
+		K_operator.MultVectorUnmasked(e, ke);
 	else
-		data = solution;
-
-	double maxValue = 0;
-	for (int i = 0; i < (int) data.size(); i++)
-		maxValue = std::max(data[i], maxValue);
-
-	glBegin(GL_TRIANGLES);
-	{
-		for (int i = 0; i < num_elems; i++) {
-			for (int j = 0; j < 3; j++) {
-				int nodeID = elements[i].GetGlobalID(j);
-
-				const Vector2 &pos = GetNodePosition(nodeID);
-				double val = data[nodeID] / maxValue;
-
-				/* Map values in interval to HSV hue range (blue = 0, red = max) */
-				double s = 1.0;
-				double v = 1.0;
-
-				if (val < 0.0) {
-					val = 0.0;
-					v = 0.0;
-				}
-				if (val > 1.0) {
-					val = 1.0;
-					v = 359.0;
-				}
-
-				double h = (1.0 - val) * 240.0;
-
-				double r, g, b;
-				r = g = b = 0.0;
-				HSV2RGB(h, s, v, r, g, b);
-
-				glColor3f(r, g, b);
-				glVertex3f(pos[0], pos[1], 0);
+		K_matrix.MultVector(e, ke);
+
+	double energy = 0.0;
+	for (int i = 0; i < num_nodes; i++)
+		energy += e[i] * ke[i];
+	energyError = sqrt(std::max(energy, 0.0));
+}
+
+/*----------------------------------------------------------------*/
+double FEModel::EstimateError(vector<double> &indicators) {
+	assert(elementOrder == 1);
+
+	vector<int32_t> edgeNodes, edgeElements, elementEdges;
+	mesh.BuildEdges(edgeNodes, edgeElements, elementEdges);
+
+	/* The discrete solution is linear per element: Laplace u_h vanishes,
+	 the element residual is f alone */
+	TriangleQuadrature rule = GetTriangleQuadrature(
+			std::max(quadratureDegree, 2));
+	vector<Vector2> gradient(num_elems);
+	indicators.resize(num_elems);
+
+#pragma omp parallel for schedule(static)
+	for (int e = 0; e < num_elems; e++) {
+		TriangleMesh::Element element = mesh.GetElement(e);
+
+		Vector2 grad(0.0, 0.0);
+		double diameter = 0.0;
+		for (int a = 0; a < 3; a++) {
+			grad += element.GetGradient(a) * solution[element.GetNode(a)];
+
+			Vector2 d = element.GetNodePosition((a + 1) % 3)
+					- element.GetNodePosition(a);
+			diameter = std::max(diameter, d | d);
+		}
+		gradient[e] = grad;
+
+		const Vector2 &p0 = element.GetNodePosition(0);
+		const Vector2 &p1 = element.GetNodePosition(1);
+		const Vector2 &p2 = element.GetNodePosition(2);
+
+		double f2 = 0.0;
+		for (int q = 0; q < rule.numPoints; q++) {
+			const double *l = rule.points[q];
+			double f = Source_Term_f(l[0] * p0[0] + l[1] * p1[0] + l[2] * p2[0],
+					l[0] * p0[1] + l[1] * p1[1] + l[2] * p2[1]);
+			f2 += rule.weights[q] * f * f;
+		}
+
+		indicators[e] = diameter * element.GetArea() * f2;
+	}
+
+	/* Jump of the normal derivative, counted half for both sides. With
+	 the unnormalized normal n (length |E|), ((grad1 - grad2) . n)^2
+	 equals |E|^2 [du/dn]^2. */
+	int numEdges = (int) edgeNodes.size() / 2;
+	for (int edge = 0; edge < numEdges; edge++) {
+		int e1 = edgeElements[2 * edge];
+		int e2 = edgeElements[2 * edge + 1];
+		if (e2 < 0)
+			continue;
+
+		Vector2 t = mesh.GetNode(edgeNodes[2 * edge + 1])
+				- mesh.GetNode(edgeNodes[2 * edge]);
+		Vector2 normal(t[1], -t[0]);
+
+		double jump = (gradient[e1] - gradient[e2]) | normal;
+		indicators[e1] += 0.5 * jump * jump;
+		indicators[e2] += 0.5 * jump * jump;
+	}
+
+	double total = 0.0;
+	for (int e = 0; e < num_elems; e++)
+		total += indicators[e];
+
+	return sqrt(total);
+}
+
+/* Comparison for sorting element IDs by decreasing indicator */
+struct IndicatorGreater {
+	const vector<double> &indicators;
+
+	IndicatorGreater(const vector<double> &_indicators) :
+			indicators(_indicators) {
+	}
+	bool operator()(int a, int b) const {
+		return indicators[a] > indicators[b];
+	}
+};
+
+void FEModel::MarkElements(const vector<double> &indicators, double theta,
+		vector<int> &marked) {
+	int n = (int) indicators.size();
+
+	vector<int> order(n);
+	double total = 0.0;
+	for (int e = 0; e < n; e++) {
+		order[e] = e;
+		total += indicators[e];
+	}
+	std::sort(order.begin(), order.end(), IndicatorGreater(indicators));
+
+	marked.clear();
+	double sum = 0.0;
+	for (int k = 0; k < n && sum < theta * total; k++) {
+		marked.push_back(order[k]);
+		sum += indicators[order[k]];
+	}
+}
+
+void FEModel::RefineElements(const vector<int> &marked) {
+	assert(elementOrder == 1);
+
+	bool wasMatrixFree = IsMatrixFree();
+	bool updateMatrix = K_matrix.IsFinalized() && !wasMatrixFree;
+	int oldNodes = num_nodes;
+
+	TriangleRefinement refinement;
+	mesh.Refine(marked, refinement);
+
+	num_nodes = mesh.GetNumNodes();
+	num_elems = mesh.GetNumTriangles();
+	grid_nodesX = grid_nodesY = 0;
+
+	/* New nodes keep their IDs as original numbering */
+	nodePerm.resize(num_nodes);
+	for (int i = oldNodes; i < num_nodes; i++)
+		nodePerm[i] = i;
+
+	solution.resize(num_nodes);
+	error.resize(num_nodes);
+	abserror.resize(num_nodes);
+
+	int numBisections = (int) refinement.bisections.size() / 3;
+	for (int k = 0; k < numBisections; k++) {
+		const int32_t *b = &refinement.bisections[3 * k];
+		solution[b[2]] = 0.5 * (solution[b[0]] + solution[b[1]]);
+	}
+
+	if (!boundaryConds.empty()) {
+		for (int i = oldNodes; i < num_nodes; i++) {
+			if (mesh.GetNodeMarker(i) != 0) {
+				const Vector2 &pos = GetNodePosition(i);
+				boundaryConds.push_back(
+						BoundaryCondition(i, Boundary_u(pos[0], pos[1])));
 			}
 		}
 	}
-	glEnd();
 
-	/* Overlay triangle edges as black lines */
-	glColor3f(0.0, 0.0, 0.0);
-	glBegin(GL_LINES);
-	{
-		for (int i = 0; i < num_elems; i++) {
-			for (int j = 0; j < 3; j++) {
-				int nodeID1 = elements[i].GetGlobalID(j);
-				int nodeID2 = elements[i].GetGlobalID((j + 1) % 3);
+	int numParents = (int) refinement.parents.size();
+	int numChildren = (int) refinement.children.size();
+
+	/* The parents are gone from the mesh; their contributions are
+	 recomputed from the (unchanged) node positions */
+	if (updateMatrix) {
+		K_triplets.Reset(num_nodes, 6 * (numParents + numChildren));
+
+		for (int p = 0; p < numParents; p++) {
+			const int32_t *v = &refinement.parentNodes[3 * p];
 
-				const Vector2 &pos1 = GetNodePosition(nodeID1);
-				const Vector2 &pos2 = GetNodePosition(nodeID2);
+			double area, gradX[3], gradY[3], stiffness[6];
+			TriangleMesh::ComputeGeometry(mesh.GetNode(v[0]),
+					mesh.GetNode(v[1]), mesh.GetNode(v[2]), area, gradX, gradY);
+			TriangleMesh::ComputeStiffness(area, gradX, gradY, stiffness);
 
-				glVertex3f(pos1[0], pos1[1], 0);
-				glVertex3f(pos2[0], pos2[1], 0);
+			for (int j = 0; j < 6; j++) {
+				int a = v[TriangleMesh::GetStiffnessPair(j, 0)];
+				int b = v[TriangleMesh::GetStiffnessPair(j, 1)];
+				K_triplets.Add(std::max(a, b), std::min(a, b), -stiffness[j]);
 			}
 		}
+
+		for (int c = 0; c < numChildren; c++) {
+			TriangleMesh::Element e = mesh.GetElement(refinement.children[c]);
+
+			double stiffness[6];
+			e.ComputeStiffness(stiffness);
+
+			for (int j = 0; j < 6; j++) {
+				int a = e.GetNode(TriangleMesh::GetStiffnessPair(j, 0));
+				int b = e.GetNode(TriangleMesh::GetStiffnessPair(j, 1));
+				K_triplets.Add(std::max(a, b), std::min(a, b), stiffness[j]);
+			}
+		}
+
+		SparseSymmetricMatrix delta;
+		K_triplets.BuildMatrix(delta);
+
+		/* Bisected edges no longer couple their end nodes */
+		vector<std::pair<int, int> > removed(numBisections);
+		for (int k = 0; k < numBisections; k++) {
+			int a = refinement.bisections[3 * k];
+			int b = refinement.bisections[3 * k + 1];
+			removed[k] = std::make_pair(std::max(a, b), std::min(a, b));
+		}
+		std::sort(removed.begin(), removed.end());
+
+		K_matrix.AddMatrix(delta, removed);
+	} else
+		K_matrix.ClearResize(num_nodes);
+
+	rhs.resize(num_nodes, 0.0);
+	if (rhsSource) {
+		TriangleQuadrature rule = GetTriangleQuadrature(quadratureDegree);
+
+		for (int p = 0; p < numParents; p++) {
+			const int32_t *v = &refinement.parentNodes[3 * p];
+			const Vector2 &p0 = mesh.GetNode(v[0]);
+			const Vector2 &p1 = mesh.GetNode(v[1]);
+			const Vector2 &p2 = mesh.GetNode(v[2]);
+
+			double area, gradX[3], gradY[3], contrib[3];
+			TriangleMesh::ComputeGeometry(p0, p1, p2, area, gradX, gradY);
+			ElementLoad(rule, rhsSource, p0, p1, p2, contrib);
+
+			for (int j = 0; j < 3; j++)
+				rhs[v[j]] -= area * contrib[j];
+		}
+
+		for (int c = 0; c < numChildren; c++) {
+			TriangleMesh::Element e = mesh.GetElement(refinement.children[c]);
+
+			double contrib[3];
+			ElementLoad(rule, rhsSource, e.GetNodePosition(0),
+					e.GetNodePosition(1), e.GetNodePosition(2), contrib);
+
+			for (int j = 0; j < 3; j++)
+				rhs[e.GetNode(j)] += e.GetArea() * contrib[j];
+		}
 	}
-	glEnd();
-}
 
+	/* The element scatter offsets and the coloring are rebuilt on demand */
+	K_patternValid = false;
+	coloringValid = false;
+
+	/* The stencil no longer applies; assemble K instead */
+	if (wasMatrixFree)
+		BuildStiffnessPattern();
+}
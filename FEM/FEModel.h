@@ -16,9 +16,19 @@
 #ifndef __FE_MODEL_H__
 #define __FE_MODEL_H__
 
+#include "MeshColoring.h"
+#include "Parallel.h"
+#include "AMG.h"
+#include "GeometricMG.h"
+#include "GridOperator.h"
+#include "LagrangeTriangle.h"
+#include "MixedPrecision.h"
 #include "PCGT.h"
+#include "SparseLDLT.h"
+#include "SparseTriplets.h"
+#include "TriangleMesh.h"
+#include "TriangleQuadrature.h"
 #include "Vec2.h"
-#include "LinTriElement.h"
 
 /*----------------------------------------------------------------*/
 class BoundaryCondition {
@@ -39,13 +49,49 @@ private:
 	double value;
 };
 
+/*----------------------------------------------------------------*/
+/* Scalar field over the domain (source terms, boundary values) */
+typedef double (*ScalarFunction)(double x, double y);
+
+/* Linear solver used by FEModel::Solve */
+enum SolverType {
+	SOLVER_PCG, /* Preconditioned conjugate gradients, see PreconditionerType */
+	SOLVER_DIRECT /* Sparse LDL^T factorization with minimum degree ordering */
+};
+
+/* Node renumbering strategies for FEModel::RenumberNodes */
+enum NodeOrdering {
+	ORDER_RCM, /* Reverse Cuthill-McKee (bandwidth reduction) */
+	ORDER_MORTON /* Z-order space-filling curve over node positions */
+};
+
+/* Preconditioner used by the PCG solver in FEModel::Solve */
+enum PreconditionerType {
+	PRECOND_JACOBI, /* Diagonal scaling */
+	PRECOND_IC0, /* Zero-fill incomplete Cholesky */
+	PRECOND_GMG, /* One geometric multigrid V-cycle (uniform grids only,
+	 see FEModel::GetActivePreconditioner) */
+	PRECOND_AMG /* One smoothed-aggregation AMG V-cycle */
+};
+
 /*----------------------------------------------------------------*/
 class FEModel {
 private:
-	vector<Vector2> nodes; /* Coordinates of vertices */
-	vector<LinTriElement> elements; /* Triangular elements */
+	TriangleMesh mesh; /* Vertices and triangular elements */
+	int elementOrder; /* Polynomial order of the elements, 1 or 2 */
+	vector<int32_t> elemNodes; /* Nodes per element for order > 1 (local
+	 order of LagrangeTriangleT); linear elements use the mesh triangles */
 	SparseSymmetricMatrix K_matrix;
+	UniformGridOperatorT<double> K_operator; /* Matrix-free K (uniform grids) */
+	bool matrixFree; /* Use K_operator instead of assembling K_matrix */
+	SparseTripletBuilder K_triplets; /* Assembly buffer for K_matrix */
+	vector<int> K_scatter; /* Per element: 6 offsets into K_matrix values */
+	bool K_patternValid; /* K_matrix pattern and K_scatter match the mesh */
+	MeshColoring elemColoring; /* Conflict-free element schedule */
+	bool coloringValid; /* elemColoring matches the elements */
+	int quadratureDegree; /* Gauss rule used for load vectors */
 	vector<double> rhs; /* Right-hand side */
+	ScalarFunction rhsSource; /* Source term of rhs, NULL if not computed */
 
 	vector<BoundaryCondition> boundaryConds;
 
@@ -55,35 +101,240 @@ private:
 
 	int num_nodes; /* Number of nodes */
 	int num_elems; /* Number of elements */
+	int grid_nodesX, grid_nodesY; /* Dimensions of a uniform grid mesh */
+	vector<int> nodePerm; /* Internal node ID -> ID given by the mesh generator */
+
+	SolverType solverType;
+	PreconditionerType precondType;
+	PCGVariant pcgVariant;
+	bool mixedPrecision; /* Float PCG inside double iterative refinement */
+
+	/* Solvers whose setup is kept between Solve() calls; both redo it by
+	 themselves when K_reduced has another generation than the matrix
+	 they were set up for (see SparseSymmetricMatrixT::GetGeneration) */
+	SparseLinSolverPCGT<double, AlgebraicMultigridT<double> > amgSolver;
+	SparseLDLT<double> directSolver;
+
+	/* Mixed-precision solvers, one per preconditioner; each keeps its
+	 float copy of K_reduced and inner setup the same way */
+	MixedPrecisionSolverT<> mixedJacobi;
+	MixedPrecisionSolverT<IncompleteCholeskyPreconditionerT<float> > mixedIC0;
+	MixedPrecisionSolverT<GeometricMultigridT<float> > mixedGMG;
+	MixedPrecisionSolverT<AlgebraicMultigridT<float> > mixedAMG;
+	SolverStats solverStats; /* Record of the last Solve() */
+
+	/* K with the boundary rows and columns decoupled (FixMatrix), rebuilt
+	 only if matrix or boundary nodes changed; its storage is reused */
+	SparseSymmetricMatrix K_reduced;
+	uint64_t reducedGeneration; /* Of the K_matrix K_reduced comes from */
+	vector<char> boundaryMask; /* Nodes with a boundary condition */
+	vector<double> boundaryValues; /* Their values, 0 elsewhere */
+	vector<double> reducedRhs; /* Right-hand side of K_reduced */
+
+	void InitializeMesh();
+	void UpdateReducedSystem();
+
+	const int32_t *GetElementNodes() const {
+		return elementOrder == 1 ? mesh.GetConnectivity() : elemNodes.data();
+	}
+	int GetNodesPerElement() const {
+		return elementOrder == 1 ? 3 : LagrangeTriangleT<2>::NUM_NODES;
+	}
+
+	/* Assembly for elements of order > 1 (LagrangeTriangleT) */
+	template<int ORDER> void BuildLagrangePattern();
+	template<int ORDER> void AssembleLagrange();
+	template<int ORDER> void ComputeLagrangeLoad(ScalarFunction source,
+			vector<double> &load);
+	template<int ORDER> double ComputeL2Error() const;
 
 public:
 	FEModel(void) {
 		num_nodes = 0;
 		num_elems = 0;
+		grid_nodesX = grid_nodesY = 0;
+		elementOrder = 1;
+		K_patternValid = false;
+		coloringValid = false;
+		rhsSource = NULL;
+		quadratureDegree = 1;
+		matrixFree = false;
+		solverType = SOLVER_PCG;
+		precondType = PRECOND_JACOBI;
+		pcgVariant = PCG_STANDARD;
+		mixedPrecision = false;
+		amgSolver.SetPreconditionerReuse(true);
+		mixedJacobi.SetReuse(true);
+		mixedIC0.SetReuse(true);
+		mixedGMG.SetReuse(true);
+		mixedAMG.SetReuse(true);
+		reducedGeneration = 0;
 	}
 
 	virtual const Vector2 &GetNodePosition(int nodeID) const {
-		return nodes[nodeID];
+		return mesh.GetNode(nodeID);
 	}
 
-	virtual void AddToStiffnessMatrix(int i, int j, double val) {
-		/* The solver expects a lower triangular matrix */
-		// changed from (j < i), I think this is due to the weird indexing in PS and Lecture notation with
-		// i starting at 1 and j at 0. Now both start at 0 and this allows entries in the diagonal.
-		// Note that non-zero values in the diagonal are required by the solver
-		if (j <= i)
-			K_matrix(i, j) += val;
+	/* Product kernel used by K_matrix (and the systems derived from it) */
+	void SetSpMVBackend(SpMVBackend backend) {
+		K_matrix.SetSpMVBackend(backend);
+	}
+
+	void SetSolver(SolverType type) {
+		solverType = type;
+	}
+
+	void SetPreconditioner(PreconditionerType type) {
+		precondType = type;
+	}
+
+	/* Preconditioner used by the next solve: PRECOND_GMG needs a mesh from
+	 CreateUniformGridMesh in its original numbering (linear elements, not
+	 renumbered or refined); on other meshes AMG is used instead */
+	PreconditionerType GetActivePreconditioner() const {
+		if (precondType == PRECOND_GMG && grid_nodesX == 0)
+			return PRECOND_AMG;
+		return precondType;
+	}
+
+	/* Loop organization of the PCG solver, see PCGT.h */
+	void SetPCGVariant(PCGVariant variant) {
+		pcgVariant = variant;
+	}
+
+	/* Run the PCG iterations in single precision inside a double-precision
+	 refinement loop (see MixedPrecision.h); same residual target. Not a
+	 performance mode: float only shrinks the matrix values, not the
+	 indices, and the restarted inner solves need more iterations, so it
+	 is slower than the double solve with every preconditioner here */
+	void SetMixedPrecision(bool enable) {
+		mixedPrecision = enable;
+	}
+
+	/* Apply K through a stencil instead of assembling it; only for meshes
+	 from CreateUniformGridMesh, otherwise K is assembled as usual. The
+	 matrix-free system is solved by Jacobi-preconditioned CG. */
+	void SetMatrixFree(bool enable) {
+		matrixFree = enable;
+	}
+
+	bool IsMatrixFree() const {
+		return matrixFree && grid_nodesX > 0;
+	}
+
+	/* Degree of the triangle Gauss rule for the source term integrals
+	 (1..TRIANGLE_QUADRATURE_MAX_DEGREE); 1 is the centroid rule */
+	void SetQuadratureDegree(int degree) {
+		assert(degree >= 1 && degree <= TRIANGLE_QUADRATURE_MAX_DEGREE);
+		quadratureDegree = degree;
+	}
+
+	/* Quadratic elements (order 2) add a node on every edge; these nodes
+	 are unknowns like the vertices and exist in the mesh, but are not
+	 used by its triangles. Takes effect with the next CreateUniformGridMesh
+	 or LoadMesh. Not supported with quadratic elements: the matrix-free
+	 operator, geometric multigrid (AMG is used instead), the system
+	 cache, error estimation and refinement. */
+	void SetElementOrder(int order) {
+		assert(order == 1 || order == 2);
+		elementOrder = order;
+	}
+
+	int GetElementOrder() const {
+		return elementOrder;
+	}
+
+	/* Unknowns, i.e. vertices plus edge nodes of quadratic elements */
+	int GetNumNodes() const {
+		return num_nodes;
+	}
+	int GetNumElements() const {
+		return num_elems;
 	}
 
 	void CreateUniformGridMesh(int nodesX, int nodesY);
+	bool LoadMesh(const char *filename);
+	void RenumberNodes(NodeOrdering ordering);
+
+	/* Node IDs as created by the mesh generator; all other methods use
+	 the internal (possibly renumbered) IDs */
+	int GetOriginalNodeID(int nodeID) const {
+		return nodePerm[nodeID];
+	}
+	void GetSolution(vector<double> &values) const;
 
+	/* Binary cache of mesh, assembled matrix, right-hand side, boundary
+	 conditions and solution, keyed by ComputeSystemKey() */
+	uint64_t ComputeSystemKey() const;
+	bool SaveSystem(const char *filename) const;
+	bool LoadSystem(const char *filename);
+
+	void ColorElements();
+	void BuildStiffnessPattern();
 	void AssembleStiffnessMatrix();
 	void SetBoundaryConditions();
 	void ComputeRHS();
+	void ComputeLoadVector(ScalarFunction source, vector<double> &load);
+
+	/* Right-hand side and boundary values for another source term or
+	 boundary function, e.g. in time steps or parameter sweeps. They keep
+	 the boundary nodes and thus the reduced system and the solver setup
+	 of the last Solve(). */
+	void ComputeRHS(ScalarFunction source);
+	void SetBoundaryValues(ScalarFunction boundary);
 
+	/* Solves the system with the boundary conditions applied. The matrix
+	 with boundary rows and columns decoupled is kept between calls and
+	 only rebuilt after the matrix or the set of boundary nodes changed;
+	 the right-hand side is reduced with one pass over K. PCG starts from
+	 the current solution (the previous result, or the interpolation after
+	 RefineElements), with the boundary values filled in. */
 	void Solve();
+
+	/* Residual-based a posteriori estimate of the energy error of the
+	 current solution. indicators[e] receives the squared local indicator
+	 h_e^2 ||f||_e^2 + 1/2 sum over interior edges E of |E|^2 [du/dn]_E^2,
+	 the return value is the square root of their sum. Linear elements
+	 only. */
+	double EstimateError(vector<double> &indicators);
+
+	/* Doerfler marking: the fewest elements whose indicators sum up to at
+	 least theta (0..1) times the total */
+	static void MarkElements(const vector<double> &indicators, double theta,
+			vector<int> &marked);
+
+	/* Refines the marked elements by newest vertex bisection (see
+	 TriangleMesh::Refine). An assembled K_matrix and a computed right-hand
+	 side are updated incrementally: only the refined elements are
+	 subtracted and their children added. The solution is interpolated to
+	 the new nodes (a good initial guess for the next Solve), boundary
+	 conditions are extended to new boundary nodes if set. The mesh is no
+	 longer a uniform grid afterwards; a matrix-free model switches to the
+	 assembled K. Linear elements only. */
+	void RefineElements(const vector<int> &marked);
+
+	/* Solves K*u = f for several source terms f = sources[v] and Dirichlet
+	 values boundaries[v] on the nodes set by SetBoundaryConditions, all
+	 with one pass over K per iteration. Entry v of node i (generator
+	 numbering) is returned in solutions[i * sources.size() + v]. Needs
+	 the assembled matrix, i.e. not available in matrix-free mode. */
+	void SolveMultiple(const vector<ScalarFunction> &sources,
+			const vector<ScalarFunction> &boundaries, vector<double> &solutions);
+
+	/* Iterations, residual history and timings of the last Solve(); for
+	 the direct solver timeSetup holds the factorization and timePrecond
+	 the triangular solves */
+	const SolverStats &GetSolverStats() const {
+		return solverStats;
+	}
 	double ComputeError();
 
+	/* Errors against the exact solution: maximum over the nodes, L2 norm
+	 of u - u_h (Gauss rule of degree 5) and the energy norm sqrt(e^T K e)
+	 of the nodal error e */
+	void ComputeErrorNorms(double &maxError, double &l2Error,
+			double &energyError) const;
+
 	void Render(int toggle_vis);
 };
 
@@ -0,0 +1,91 @@
+/******************************************************************
+ *
+ * FEModelRender.cpp
+ *
+ * Description: Visualization of the Finite Element Model with legacy
+ * OpenGL. Kept apart from FEModel.cpp so that the model can be built
+ * and run without OpenGL (see FEMBatch.cpp).
+ *
+ * Physically-Based Simulation Proseminar WS 2015
+ *
+ * Interactive Graphics and Simulation Group
+ * Institute of Computer Science
+ * University of Innsbruck
+ *
+ *******************************************************************/
+
+#include "GL/glut.h"  
+#include <math.h>
+
+#include "HSV2RGB.h"
+#include "FEModel.h"
+
+/*----------------------------------------------------------------*/
+void FEModel::Render(int toggle_vis) {
+	vector<double> data;
+
+	/* Select data to display */
+	if (toggle_vis)
+		data = abserror;
+	else
+		data = solution;
+
+	double maxValue = 0;
+	for (int i = 0; i < (int) data.size(); i++)
+		maxValue = std::max(data[i], maxValue);
+
+	glBegin(GL_TRIANGLES);
+	{
+		for (TriangleMesh::ElementIterator e = mesh.begin(); e != mesh.end(); ++e) {
+			for (int j = 0; j < 3; j++) {
+				int nodeID = e->GetNode(j);
+
+				const Vector2 &pos = GetNodePosition(nodeID);
+				double val = data[nodeID] / maxValue;
+
+				/* Map values in interval to HSV hue range (blue = 0, red = max) */
+				double s = 1.0;
+				double v = 1.0;
+
+				if (val < 0.0) {
+					val = 0.0;
+					v = 0.0;
+				}
+				if (val > 1.0) {
+					val = 1.0;
+					v = 359.0;
+				}
+
+				double h = (1.0 - val) * 240.0;
+
+				double r, g, b;
+				r = g = b = 0.0;
+				HSV2RGB(h, s, v, r, g, b);
+
+				glColor3f(r, g, b);
+				glVertex3f(pos[0], pos[1], 0);
+			}
+		}
+	}
+	glEnd();
+
+	/* Overlay triangle edges as black lines */
+	glColor3f(0.0, 0.0, 0.0);
+	glBegin(GL_LINES);
+	{
+		for (TriangleMesh::ElementIterator e = mesh.begin(); e != mesh.end(); ++e) {
+			for (int j = 0; j < 3; j++) {
+				int nodeID1 = e->GetNode(j);
+				int nodeID2 = e->GetNode((j + 1) % 3);
+
+				const Vector2 &pos1 = GetNodePosition(nodeID1);
+				const Vector2 &pos2 = GetNodePosition(nodeID2);
+
+				glVertex3f(pos1[0], pos1[1], 0);
+				glVertex3f(pos2[0], pos2[1], 0);
+			}
+		}
+	}
+	glEnd();
+}
+
@@ -0,0 +1,65 @@
+/******************************************************************
+*
+* GridMatrix.h
+*
+* Description: Test matrices shared by the benchmarks.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __GRIDMATRIX_H__
+#define __GRIDMATRIX_H__
+
+#include <algorithm>
+#include <vector>
+
+#include "SparseSymMat.h"
+#include "SparseTriplets.h"
+
+/* 5-point stencil of the linear triangle discretization on a uniform
+   grid (the diagonal couplings vanish for right triangles); grid node
+   i gets the matrix index inv[i] */
+inline void BuildGridMatrix(int grid, const vector<int> &inv, SparseSymmetricMatrix &mat)
+{
+    int n = grid * grid;
+
+    SparseTripletBuilder builder;
+    builder.Reset(n, 3 * n);
+
+    for(int y=0; y<grid; y++)
+    {
+        for(int x=0; x<grid; x++)
+        {
+            int i = inv[y * grid + x];
+            builder.Add(i, i, 4.0);
+            if(x > 0)
+            {
+                int j = inv[y * grid + x - 1];
+                builder.Add(std::max(i, j), std::min(i, j), -1.0);
+            }
+            if(y > 0)
+            {
+                int j = inv[(y - 1) * grid + x];
+                builder.Add(std::max(i, j), std::min(i, j), -1.0);
+            }
+        }
+    }
+
+    builder.BuildMatrix(mat);
+}
+
+inline void BuildGridMatrix(int grid, SparseSymmetricMatrix &mat)
+{
+    vector<int> identity(grid * grid);
+    for(int i=0; i<grid * grid; i++)
+        identity[i] = i;
+
+    BuildGridMatrix(grid, identity, mat);
+}
+
+#endif
@@ -0,0 +1,81 @@
+/******************************************************************
+*
+* MixedPrecisionBench.cpp
+*
+* Description: Compares the double-precision Jacobi-PCG solve with 
+* mixed-precision iterative refinement (float PCG inside, double 
+* residuals outside) on the uniform grid matrix. The right-hand side 
+* is b = A*x* for a known x*, so the table reports time, iterations 
+* and the relative max-norm error |x - x*| / |x*| of both solvers 
+* next to the final scaled residual.
+*
+* Usage: MixedPrecisionBench [maxGrid]   (default 1024 nodes per axis)
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "GridMatrix.h"
+#include "MixedPrecision.h"
+#include "PCGT.h"
+
+/*----------------------------------------------------------------*/
+double RelativeError(const vector<double> &x, const vector<double> &exact)
+{
+    double err = 0;
+    double nrm = 0;
+    for(int i=0; i<(int)x.size(); i++)
+    {
+        err = std::max(err, fabs(x[i] - exact[i]));
+        nrm = std::max(nrm, fabs(exact[i]));
+    }
+    return err / nrm;
+}
+
+int main(int argc, char *argv[])
+{
+    int maxGrid = 1024;
+    if(argc == 2)
+        maxGrid = atoi(argv[1]);
+
+    printf("grid,double_ms,double_iter,double_error,double_residual,"
+           "mixed_ms,mixed_iter,refinements,mixed_error,mixed_residual,speedup\n");
+
+    for(int grid=64; grid<=maxGrid; grid*=2)
+    {
+        SparseSymmetricMatrix mat;
+        BuildGridMatrix(grid, mat);
+
+        int n = mat.GetNumRows();
+        vector<double> exact(n), b(n);
+        for(int y=0; y<grid; y++)
+            for(int x=0; x<grid; x++)
+                exact[y * grid + x] = sin(3.0 * x / grid) * cos(2.0 * y / grid) + 1.0;
+        mat.MultVector(exact, b);
+
+        vector<double> xDouble(n, 0.0);
+        SparseLinSolverPCGT<double> solver;
+        SolverStats statsDouble = solver.SolveLinearSystem(mat, xDouble, b, 1e-6, -1);
+
+        vector<double> xMixed(n, 0.0);
+        MixedPrecisionSolverT<> mixed;
+        SolverStats statsMixed = mixed.SolveLinearSystem(mat, xMixed, b, 1e-6, -1);
+
+        printf("%d,%.3f,%d,%.3g,%.3g,%.3f,%d,%d,%.3g,%.3g,%.2f\n", grid, 
+               statsDouble.timeTotal * 1e3, statsDouble.iterations, 
+               RelativeError(xDouble, exact), statsDouble.residuals.back(),
+               statsMixed.timeTotal * 1e3, statsMixed.iterations, statsMixed.refinements,
+               RelativeError(xMixed, exact), statsMixed.residuals.back(),
+               statsDouble.timeTotal / statsMixed.timeTotal);
+    }
+
+    return 0;
+}
@@ -0,0 +1,280 @@
+/******************************************************************
+*
+* SpMVBench.cpp
+*
+* Description: Benchmark for the sparse matrix-vector product used in
+* the PCG hot loop. Builds the stiffness matrix of the uniform grid 
+* (linear triangles, unit square) for a range of resolutions. The 
+* first table takes the serial scatter kernel (each lower entry also 
+* added to the transposed position, as MultVector did before the
+* transpose index) as reference and compares the row gather kernel
+* that MultVector uses now, on one thread and on all threads, and the
+* SELL-C-sigma backend on all threads. A second table shows the effect
+* of node renumbering: the grid numbered randomly (as an unstructured
+* mesher might) versus reverse Cuthill-McKee and Morton order. The last
+* table times 8 Jacobi-PCG solves one after another against one
+* multi-RHS solve (SolveMultiple) of the same 8 right-hand sides.
+*
+* Usage: SpMVBench [maxGrid]   (default 2048 nodes per axis)
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "GridMatrix.h"
+#include "NodeOrdering.h"
+#include "Parallel.h"
+#include "PCGT.h"
+
+/*----------------------------------------------------------------*/
+/* Inverse of perm (perm[new] = old) composed with the numbering inv */
+vector<int> Renumber(const vector<int> &inv, const vector<int> &perm)
+{
+    vector<int> result(inv.size());
+    vector<int> permInv(perm.size());
+    for(int i=0; i<(int)perm.size(); i++)
+        permInv[perm[i]] = i;
+
+    for(int i=0; i<(int)inv.size(); i++)
+        result[i] = permInv[inv[i]];
+
+    return result;
+}
+
+/* b = A*x with the lower triangle scattered to the upper one; serial
+   reference, not thread-safe */
+void MultVectorScatter(const SparseSymmetricMatrix &mat, const vector<double> &x,
+                       vector<double> &b)
+{
+    const vector<int> &rowPtr = mat.GetRowPtr();
+    const vector<int> &colIdx = mat.GetColIdx();
+    const vector<double> &values = mat.GetValues();
+    int nrows = mat.GetNumRows();
+
+    std::fill(b.begin(), b.end(), 0.0);
+
+    for(int row=0; row<nrows; row++)
+    {
+        double rowSum = 0;
+        double xRow = x[row];
+
+        for(int k=rowPtr[row]; k<rowPtr[row + 1]; k++)
+        {
+            int col = colIdx[k];
+            double val = values[k];
+
+            rowSum += val * x[col];
+
+            if(col < row)
+                b[col] += val * xRow;
+        }
+
+        b[row] += rowSum;
+    }
+}
+
+enum Kernel { KERNEL_SCATTER, KERNEL_GATHER, KERNEL_SELL };
+
+/* Average seconds per product */
+double TimeProducts(const SparseSymmetricMatrix &mat, const vector<double> &x,
+                    vector<double> &b, int repetitions, Kernel kernel)
+{
+    /* Warm-up, also builds the SELL-C-sigma copy */
+    if(kernel == KERNEL_SELL)
+        mat.MultVectorSell(x, b);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for(int r=0; r<repetitions; r++)
+    {
+        if(kernel == KERNEL_GATHER)
+            mat.MultVectorGather(x, b);
+        else if(kernel == KERNEL_SELL)
+            mat.MultVectorSell(x, b);
+        else
+            MultVectorScatter(mat, x, b);
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / repetitions;
+}
+
+/*----------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+    int maxGrid = 2048;
+    if(argc == 2)
+        maxGrid = atoi(argv[1]);
+
+    int maxThreads = GetNumThreads();
+
+    /* Speedups against the serial scatter kernel; gather_serial_ratio
+       is the cost of the deterministic gather on one thread */
+    printf("grid,nnz,threads,scatter_ms,gather_serial_ms,gather_serial_ratio,"
+           "gather_ms,gather_speedup,sell_ms,sell_speedup,max_abs_diff\n");
+
+    for(int grid=64; grid<=maxGrid; grid*=2)
+    {
+        SparseSymmetricMatrix mat;
+        BuildGridMatrix(grid, mat);
+
+        int n = mat.GetNumRows();
+        vector<double> x(n), bScatter(n), bSerial(n), bGather(n), bSell(n);
+        for(int i=0; i<n; i++)
+            x[i] = sin(0.001 * i);
+
+        /* Aim for roughly 1e8 processed entries per measurement */
+        int repetitions = std::max(3, 100000000 / mat.GetNumNonZeros());
+
+        SetNumThreads(1);
+        double scatter = TimeProducts(mat, x, bScatter, repetitions, KERNEL_SCATTER);
+        double serial = TimeProducts(mat, x, bSerial, repetitions, KERNEL_GATHER);
+
+        SetNumThreads(maxThreads);
+        double gather = TimeProducts(mat, x, bGather, repetitions, KERNEL_GATHER);
+        double sell = TimeProducts(mat, x, bSell, repetitions, KERNEL_SELL);
+
+        double diff = 0;
+        for(int i=0; i<n; i++)
+        {
+            diff = std::max(diff, fabs(bScatter[i] - bSerial[i]));
+            diff = std::max(diff, fabs(bScatter[i] - bGather[i]));
+            diff = std::max(diff, fabs(bScatter[i] - bSell[i]));
+        }
+
+        printf("%d,%d,%d,%.4f,%.4f,%.2f,%.4f,%.2f,%.4f,%.2f,%g\n", grid, 
+               mat.GetNumNonZeros(), maxThreads, scatter * 1e3, serial * 1e3, 
+               serial / scatter, gather * 1e3, scatter / gather, 
+               sell * 1e3, scatter / sell, diff);
+    }
+
+    printf("\ngrid,shuffled_ms,rcm_ms,rcm_speedup,morton_ms,morton_speedup\n");
+
+    SetNumThreads(1);
+    for(int grid=64; grid<=maxGrid; grid*=2)
+    {
+        int n = grid * grid;
+
+        /* Random numbering: inv[grid node] = matrix index */
+        vector<int> shuffled(n);
+        for(int i=0; i<n; i++)
+            shuffled[i] = i;
+        srand(42);
+        for(int i=n-1; i>0; i--)
+            std::swap(shuffled[i], shuffled[rand() % (i + 1)]);
+
+        SparseSymmetricMatrix mat;
+        BuildGridMatrix(grid, shuffled, mat);
+
+        /* Node graph and positions in the shuffled numbering */
+        vector<int> adjPtr(n + 1, 0);
+        vector<int> adj;
+        const vector<int> &rowPtr = mat.GetRowPtr();
+        const vector<int> &colIdx = mat.GetColIdx();
+        vector<vector<int> > nbrs(n);
+        for(int i=0; i<n; i++)
+        {
+            for(int k=rowPtr[i]; k<rowPtr[i + 1]; k++)
+            {
+                if(colIdx[k] != i)
+                {
+                    nbrs[i].push_back(colIdx[k]);
+                    nbrs[colIdx[k]].push_back(i);
+                }
+            }
+        }
+        for(int i=0; i<n; i++)
+        {
+            adj.insert(adj.end(), nbrs[i].begin(), nbrs[i].end());
+            adjPtr[i + 1] = (int)adj.size();
+        }
+
+        vector<Vector2> pos(n);
+        for(int i=0; i<n; i++)
+            pos[shuffled[i]] = Vector2(i % grid, i / grid);
+
+        vector<int> rcmPerm, mortonPerm;
+        ReverseCuthillMcKee(adjPtr, adj, rcmPerm);
+        MortonOrdering(pos, mortonPerm);
+
+        SparseSymmetricMatrix rcm, morton;
+        BuildGridMatrix(grid, Renumber(shuffled, rcmPerm), rcm);
+        BuildGridMatrix(grid, Renumber(shuffled, mortonPerm), morton);
+
+        vector<double> x(n), b(n);
+        for(int i=0; i<n; i++)
+            x[i] = sin(0.001 * i);
+
+        int repetitions = std::max(3, 100000000 / mat.GetNumNonZeros());
+        double tShuffled = TimeProducts(mat, x, b, repetitions, KERNEL_GATHER);
+        double tRcm = TimeProducts(rcm, x, b, repetitions, KERNEL_GATHER);
+        double tMorton = TimeProducts(morton, x, b, repetitions, KERNEL_GATHER);
+
+        printf("%d,%.4f,%.4f,%.2f,%.4f,%.2f\n", grid, tShuffled * 1e3, 
+               tRcm * 1e3, tShuffled / tRcm, tMorton * 1e3, tShuffled / tMorton);
+    }
+
+    printf("\ngrid,rhs,sequential_ms,block_ms,block_speedup,max_abs_diff\n");
+
+    SetNumThreads(maxThreads);
+    for(int grid=64; grid<=std::min(maxGrid, 512); grid*=2)
+    {
+        const int k = 8;
+
+        SparseSymmetricMatrix mat;
+        BuildGridMatrix(grid, mat);
+
+        int n = mat.GetNumRows();
+        vector<double> B(n * k), X(n * k, 0.0);
+        for(int i=0; i<n; i++)
+            for(int v=0; v<k; v++)
+                B[i * k + v] = sin(0.001 * (v + 1) * i);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        vector<double> b(n), x(n), sequential(n * k);
+        for(int v=0; v<k; v++)
+        {
+            for(int i=0; i<n; i++)
+            {
+                b[i] = B[i * k + v];
+                x[i] = 0;
+            }
+
+            SparseLinSolverPCGT<double> solver;
+            solver.SolveLinearSystem(mat, x, b, 1e-6, -1);
+
+            for(int i=0; i<n; i++)
+                sequential[i * k + v] = x[i];
+        }
+
+        std::chrono::steady_clock::time_point mid = std::chrono::steady_clock::now();
+
+        SparseLinSolverPCGT<double> solver;
+        solver.SolveMultiple(mat, X, B, k, 1e-6, -1);
+
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        std::chrono::duration<double> tSequential = mid - start;
+        std::chrono::duration<double> tBlock = end - mid;
+
+        double diff = 0;
+        for(int i=0; i<n * k; i++)
+            diff = std::max(diff, fabs(sequential[i] - X[i]));
+
+        printf("%d,%d,%.4f,%.4f,%.2f,%g\n", grid, k, tSequential.count() * 1e3, 
+               tBlock.count() * 1e3, tSequential.count() / tBlock.count(), diff);
+    }
+
+    return 0;
+}
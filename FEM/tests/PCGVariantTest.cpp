@@ -0,0 +1,85 @@
+/******************************************************************
+*
+* PCGVariantTest.cpp
+*
+* Description: Convergence test for the PCG loop variants. Solves the
+* model problem on a uniform grid with every preconditioner and every
+* variant (standard, fused, pipelined). Each solve must converge, reach
+* the maximum error of the standard loop and need about the same
+* number of iterations; the variants only reorder the same recurrences.
+*
+* Usage: PCGVariantTest [grid]   (default 65 vertices per axis)
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+/* Standard includes */
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+/* Local includes */
+#include "../FEModel.h"
+
+
+/*----------------------------------------------------------------*/
+SolverStats Solve(int grid, PreconditionerType precond, PCGVariant variant,
+                  double &maxError)
+{
+    FEModel model;
+    model.SetPreconditioner(precond);
+    model.SetPCGVariant(variant);
+    model.CreateUniformGridMesh(grid, grid);
+    model.AssembleStiffnessMatrix();
+    model.ComputeRHS();
+    model.SetBoundaryConditions();
+    model.Solve();
+
+    double l2Error, energyError;
+    model.ComputeErrorNorms(maxError, l2Error, energyError);
+
+    return model.GetSolverStats();
+}
+
+/*----------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+    int grid = argc > 1 ? atoi(argv[1]) : 65;
+
+    const PreconditionerType preconds[] = { PRECOND_JACOBI, PRECOND_IC0, 
+                                            PRECOND_GMG, PRECOND_AMG };
+    const char *precondNames[] = { "jacobi", "ic0", "gmg", "amg" };
+    const char *variantNames[] = { "standard", "fused", "pipelined" };
+
+    int failures = 0;
+
+    for(int p=0; p<4; p++)
+    {
+        double reference;
+        SolverStats standard = Solve(grid, preconds[p], PCG_STANDARD, reference);
+
+        for(int v=PCG_STANDARD; v<=PCG_PIPELINED; v++)
+        {
+            double maxError;
+            SolverStats stats = Solve(grid, preconds[p], (PCGVariant)v, maxError);
+
+            /* Rounding differs between the variants, the iterate may not */
+            bool ok = stats.converged &&
+                      fabs(maxError - reference) <= 1e-2 * reference &&
+                      abs(stats.iterations - standard.iterations) <= 2;
+
+            printf("%-6s %-9s iterations %4d max error %g %s\n", precondNames[p],
+                   variantNames[v], stats.iterations, maxError, ok ? "ok" : "FAILED");
+
+            if(!ok)
+                failures++;
+        }
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
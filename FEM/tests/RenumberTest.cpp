@@ -0,0 +1,90 @@
+/******************************************************************
+*
+* RenumberTest.cpp
+*
+* Description: Regression test for FEModel::RenumberNodes. Solves the
+* model problem on a uniform grid once in grid order and once with
+* the nodes renumbered (RCM and Morton), both before and after the
+* right-hand side and boundary conditions are set up. Every run must
+* reach the maximum error of the unrenumbered solve; a right-hand side
+* left in the old numbering shows up as an error several orders of
+* magnitude larger.
+*
+* Usage: RenumberTest [grid]   (default 33 vertices per axis)
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+/* Standard includes */
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+/* Local includes */
+#include "../FEModel.h"
+
+
+/* Renumbering step within the setup sequence */
+enum RenumberStage { RENUMBER_NONE, RENUMBER_BEFORE_RHS, RENUMBER_AFTER_RHS };
+
+/*----------------------------------------------------------------*/
+double SolveMaxError(int grid, RenumberStage stage, NodeOrdering ordering)
+{
+    FEModel model;
+    model.CreateUniformGridMesh(grid, grid);
+
+    if(stage == RENUMBER_BEFORE_RHS)
+        model.RenumberNodes(ordering);
+
+    model.ComputeRHS();
+    model.SetBoundaryConditions();
+
+    if(stage == RENUMBER_AFTER_RHS)
+        model.RenumberNodes(ordering);
+
+    model.AssembleStiffnessMatrix();
+    model.Solve();
+
+    double maxError, l2Error, energyError;
+    model.ComputeErrorNorms(maxError, l2Error, energyError);
+
+    return maxError;
+}
+
+/*----------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+    int grid = argc > 1 ? atoi(argv[1]) : 33;
+
+    const char *orderingNames[] = { "rcm", "morton" };
+    const char *stageNames[] = { "none", "before_rhs", "after_rhs" };
+
+    double reference = SolveMaxError(grid, RENUMBER_NONE, ORDER_RCM);
+    printf("grid %d, reference max error %g\n", grid, reference);
+
+    int failures = 0;
+
+    for(int o=ORDER_RCM; o<=ORDER_MORTON; o++)
+    {
+        for(int s=RENUMBER_BEFORE_RHS; s<=RENUMBER_AFTER_RHS; s++)
+        {
+            double maxError = SolveMaxError(grid, (RenumberStage)s, (NodeOrdering)o);
+
+            /* Same discrete problem, only the PCG rounding differs */
+            bool ok = fabs(maxError - reference) <= 1e-2 * reference;
+
+            printf("%-6s %-10s max error %g %s\n", orderingNames[o], stageNames[s],
+                   maxError, ok ? "ok" : "FAILED");
+
+            if(!ok)
+                failures++;
+        }
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,214 @@
+/******************************************************************
+*
+* AMG.h
+*
+* Description: 
+*
+* Smoothed-aggregation algebraic multigrid (Vanek, Mandel, Brezina).
+* The hierarchy is built from the matrix alone, so it works for any 
+* symmetric positive-definite SparseSymmetricMatrixT, including those 
+* of unstructured meshes:
+*
+*  - strength of connection: |a_ij| > theta * sqrt(a_ii * a_jj)
+*  - aggregation: aggregates around nodes whose strong neighborhood is
+*    still free, remaining nodes join a neighboring aggregate
+*  - tentative prolongator: normalized constant per aggregate
+*  - smoothed prolongator: P = (I - omega * D^-1 * A) * P_tent with 
+*    omega = 4 / (3 * rho), rho a Gershgorin bound of D^-1 * A
+*
+* Coarse operators and the V-cycle come from Multigrid.h. Setup() is 
+* the expensive part; SparseLinSolverPCGT can keep it across solves 
+* with the same matrix (see SetPreconditionerReuse).
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __AMG_T_H__
+#define __AMG_T_H__
+
+#include <cmath>
+#include <vector>
+
+#include "Multigrid.h"
+
+template<class T>
+class AlgebraicMultigridT : public MultigridT<T>
+{
+public:
+    AlgebraicMultigridT() 
+    {
+        m_theta = T(0.08);
+        m_maxLevels = 20;
+    }
+
+    void SetStrengthThreshold(T theta) { m_theta = theta; }
+    void SetMaxLevels(int maxLevels) { m_maxLevels = maxLevels; }
+
+protected:
+    virtual void BuildHierarchy() 
+    {
+        while(this->GetNumLevels() < m_maxLevels && 
+              this->GetCoarsestMatrix().numRows > this->GetMaxCoarseRows())
+        {
+            const CSRMatrixT<T> &A = this->GetCoarsestMatrix();
+
+            vector<int> aggregate;
+            int numAggregates = Aggregate(A, aggregate);
+
+            /* Stop if coarsening stalls */
+            if(numAggregates == 0 || numAggregates > A.numRows * 9 / 10)
+                break;
+
+            CSRMatrixT<T> P;
+            BuildProlongation(A, aggregate, numAggregates, P);
+            this->AddCoarseLevel(P);
+        }
+    }
+
+private:
+    bool IsStrong(const CSRMatrixT<T> &A, int i, int k) const 
+    {
+        int j = A.colIdx[k];
+        return j != i && A.values[k] != 0 &&
+               fabs(A.values[k]) > m_theta * sqrt(fabs(A.GetDiagonal(i) * A.GetDiagonal(j)));
+    }
+
+    /* Assigns every node an aggregate index, -1 for isolated nodes;
+       returns the number of aggregates */
+    int Aggregate(const CSRMatrixT<T> &A, vector<int> &aggregate) const 
+    {
+        int n = A.numRows;
+        int numAggregates = 0;
+
+        /* Strong neighborhoods as boolean mask over the entries */
+        vector<char> strong(A.rowPtr[n]);
+        vector<char> hasStrong(n, 0);
+        for(int i=0; i<n; i++)
+        {
+            for(int k=A.rowPtr[i]; k<A.rowPtr[i + 1]; k++)
+            {
+                strong[k] = IsStrong(A, i, k);
+                if(strong[k])
+                    hasStrong[i] = 1;
+            }
+        }
+
+        aggregate.assign(n, -1);
+
+        /* Pass 1: seed aggregates from completely free neighborhoods */
+        for(int i=0; i<n; i++)
+        {
+            if(!hasStrong[i] || aggregate[i] >= 0)
+                continue;
+
+            bool free = true;
+            for(int k=A.rowPtr[i]; k<A.rowPtr[i + 1] && free; k++)
+                if(strong[k] && aggregate[A.colIdx[k]] >= 0)
+                    free = false;
+
+            if(!free)
+                continue;
+
+            aggregate[i] = numAggregates;
+            for(int k=A.rowPtr[i]; k<A.rowPtr[i + 1]; k++)
+                if(strong[k])
+                    aggregate[A.colIdx[k]] = numAggregates;
+            numAggregates++;
+        }
+
+        /* Pass 2: join the aggregate of the strongest aggregated neighbor */
+        vector<int> pass1 = aggregate;
+        for(int i=0; i<n; i++)
+        {
+            if(!hasStrong[i] || aggregate[i] >= 0)
+                continue;
+
+            T best = 0;
+            for(int k=A.rowPtr[i]; k<A.rowPtr[i + 1]; k++)
+            {
+                int j = A.colIdx[k];
+                if(strong[k] && pass1[j] >= 0 && fabs(A.values[k]) > best)
+                {
+                    best = fabs(A.values[k]);
+                    aggregate[i] = pass1[j];
+                }
+            }
+        }
+
+        /* Pass 3: leftovers form aggregates with their free neighbors */
+        for(int i=0; i<n; i++)
+        {
+            if(!hasStrong[i] || aggregate[i] >= 0)
+                continue;
+
+            aggregate[i] = numAggregates;
+            for(int k=A.rowPtr[i]; k<A.rowPtr[i + 1]; k++)
+                if(strong[k] && aggregate[A.colIdx[k]] < 0)
+                    aggregate[A.colIdx[k]] = numAggregates;
+            numAggregates++;
+        }
+
+        return numAggregates;
+    }
+
+    void BuildProlongation(const CSRMatrixT<T> &A, const vector<int> &aggregate, 
+                           int numAggregates, CSRMatrixT<T> &P) const 
+    {
+        int n = A.numRows;
+
+        /* Tentative prolongator, columns normalized */
+        vector<int> size(numAggregates, 0);
+        for(int i=0; i<n; i++)
+            if(aggregate[i] >= 0)
+                size[aggregate[i]]++;
+
+        CSRMatrixT<T> Ptent;
+        Ptent.numRows = n;
+        Ptent.numCols = numAggregates;
+        Ptent.rowPtr.assign(n + 1, 0);
+        for(int i=0; i<n; i++)
+        {
+            if(aggregate[i] >= 0)
+            {
+                Ptent.colIdx.push_back(aggregate[i]);
+                Ptent.values.push_back(1 / sqrt(T(size[aggregate[i]])));
+            }
+            Ptent.rowPtr[i + 1] = (int)Ptent.colIdx.size();
+        }
+
+        /* Jacobi smoothing operator S = I - omega * D^-1 * A */
+        T rho = 0;
+        for(int i=0; i<n; i++)
+        {
+            T rowSum = 0;
+            for(int k=A.rowPtr[i]; k<A.rowPtr[i + 1]; k++)
+                rowSum += fabs(A.values[k]);
+            rho = std::max(rho, (T)(rowSum / fabs(A.GetDiagonal(i))));
+        }
+        T omega = T(4) / (T(3) * rho);
+
+        CSRMatrixT<T> S = A;
+        for(int i=0; i<n; i++)
+        {
+            T scale = omega / A.GetDiagonal(i);
+            for(int k=S.rowPtr[i]; k<S.rowPtr[i + 1]; k++)
+            {
+                S.values[k] = -scale * A.values[k];
+                if(S.colIdx[k] == i)
+                    S.values[k] += 1;
+            }
+        }
+
+        CSRMatrixT<T>::Multiply(S, Ptent, P);
+    }
+
+    T m_theta;
+    int m_maxLevels;
+};
+
+#endif
@@ -0,0 +1,296 @@
+/******************************************************************
+*
+* BinaryCache.h
+*
+* Description:
+*
+* Versioned binary container for cached data, e.g. an assembled
+* linear system. A file consists of a header (magic, format version,
+* byte order mark, a 64-bit key identifying the cached content, a 
+* checksum of the section data), a table of sections and the section
+* data, each section 64-byte aligned.
+* Sections are identified by the user and hold arrays of fixed-size
+* elements in host byte order.
+*
+* BinaryCacheWriter collects sections and writes them to a temporary
+* file which is renamed when complete, so readers never see partial
+* files. BinaryCacheReader memory-maps a file; GetSection() returns
+* pointers into the mapping, nothing is copied.
+*
+* HashBytes() is 64-bit FNV-1a over 8-byte words, used to build keys.
+* It is meant for detecting changes, not for security.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __BINARYCACHE_H__
+#define __BINARYCACHE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+using std::vector;
+
+/*----------------------------------------------------------------*/
+const uint64_t HASH_SEED = 14695981039346656037ULL;
+
+inline uint64_t HashBytes(const void *data, size_t bytes, uint64_t hash = HASH_SEED)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    const uint64_t prime = 1099511628211ULL;
+
+    size_t numWords = bytes / 8;
+    for(size_t i=0; i<numWords; i++)
+    {
+        uint64_t w;
+        memcpy(&w, p + 8 * i, 8);
+        hash = (hash ^ w) * prime;
+    }
+
+    for(size_t i=8 * numWords; i<bytes; i++)
+        hash = (hash ^ p[i]) * prime;
+
+    /* The last words only reach the high bits otherwise */
+    return hash ^ (hash >> 29);
+}
+
+template<class T>
+inline uint64_t HashArray(const vector<T> &values, uint64_t hash = HASH_SEED)
+{
+    uint64_t size = values.size();
+    hash = HashBytes(&size, sizeof(size), hash);
+    return values.empty() ? hash : HashBytes(values.data(), values.size() * sizeof(T), hash);
+}
+
+/*----------------------------------------------------------------*/
+struct BinaryCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder; /* 0x01020304 as written by the host */
+    uint64_t key;
+    uint64_t checksum; /* HashBytes over the data of all sections */
+    uint64_t numSections;
+};
+
+struct BinaryCacheSection
+{
+    uint32_t id;
+    uint32_t elemSize;
+    uint64_t count;
+    uint64_t offset; /* From the start of the file */
+};
+
+const size_t BINARY_CACHE_ALIGNMENT = 64;
+
+/*----------------------------------------------------------------*/
+class BinaryCacheWriter
+{
+public:
+    /* magic: up to 8 characters naming the kind of content */
+    BinaryCacheWriter(const char *magic, uint32_t version, uint64_t key)
+    {
+        memset(&m_header, 0, sizeof(m_header));
+        strncpy(m_header.magic, magic, sizeof(m_header.magic));
+        m_header.version = version;
+        m_header.byteOrder = 0x01020304;
+        m_header.key = key;
+    }
+
+    /* Data must stay valid until Write() */
+    void AddSection(uint32_t id, const void *data, uint32_t elemSize, uint64_t count)
+    {
+        BinaryCacheSection section;
+        section.id = id;
+        section.elemSize = elemSize;
+        section.count = count;
+        section.offset = 0;
+
+        m_sections.push_back(section);
+        m_data.push_back(data);
+    }
+
+    template<class T>
+    void AddSection(uint32_t id, const vector<T> &values)
+    {
+        AddSection(id, values.data(), sizeof(T), values.size());
+    }
+
+    bool Write(const char *filename)
+    {
+        m_header.numSections = m_sections.size();
+
+        m_header.checksum = HASH_SEED;
+
+        uint64_t offset = align(sizeof(m_header) + m_sections.size() * sizeof(BinaryCacheSection));
+        for(size_t s=0; s<m_sections.size(); s++)
+        {
+            m_sections[s].offset = offset;
+            offset = align(offset + m_sections[s].count * m_sections[s].elemSize);
+
+            m_header.checksum = HashBytes(m_data[s], (size_t)(m_sections[s].count * m_sections[s].elemSize), 
+                                          m_header.checksum);
+        }
+
+        std::string tmpName = std::string(filename) + ".tmp";
+        FILE *file = fopen(tmpName.c_str(), "wb");
+        if(!file)
+            return false;
+
+        bool ok = fwrite(&m_header, sizeof(m_header), 1, file) == 1;
+        if(!m_sections.empty())
+            ok = ok && fwrite(&m_sections[0], sizeof(BinaryCacheSection), m_sections.size(), file) == m_sections.size();
+
+        uint64_t pos = sizeof(m_header) + m_sections.size() * sizeof(BinaryCacheSection);
+        for(size_t s=0; s<m_sections.size() && ok; s++)
+        {
+            ok = pad(file, m_sections[s].offset - pos);
+
+            size_t bytes = (size_t)(m_sections[s].count * m_sections[s].elemSize);
+            ok = ok && (bytes == 0 || fwrite(m_data[s], 1, bytes, file) == bytes);
+            pos = m_sections[s].offset + bytes;
+        }
+
+        ok = (fclose(file) == 0) && ok;
+
+        if(!ok || rename(tmpName.c_str(), filename) != 0)
+        {
+            remove(tmpName.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    BinaryCacheHeader m_header;
+    vector<BinaryCacheSection> m_sections;
+    vector<const void *> m_data;
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + BINARY_CACHE_ALIGNMENT - 1) / BINARY_CACHE_ALIGNMENT * BINARY_CACHE_ALIGNMENT;
+    }
+
+    static bool pad(FILE *file, uint64_t bytes)
+    {
+        static const char zeros[BINARY_CACHE_ALIGNMENT] = { 0 };
+        return bytes == 0 || fwrite(zeros, 1, (size_t)bytes, file) == bytes;
+    }
+};
+
+/*----------------------------------------------------------------*/
+class BinaryCacheReader
+{
+public:
+    BinaryCacheReader() : m_header(NULL), m_sections(NULL) {}
+
+    /* Fails unless the file has the given magic and version, was written
+       with the host byte order, all sections lie within the file and
+       their data matches the checksum */
+    bool Open(const char *filename, const char *magic, uint32_t version)
+    {
+        Close();
+
+        if(!m_file.Open(filename) || m_file.GetSize() < sizeof(BinaryCacheHeader))
+            return false;
+
+        const BinaryCacheHeader *header = (const BinaryCacheHeader *)m_file.GetData();
+
+        char expected[8] = { 0 };
+        strncpy(expected, magic, sizeof(expected));
+
+        if(memcmp(header->magic, expected, sizeof(expected)) != 0 ||
+           header->version != version || header->byteOrder != 0x01020304 ||
+           header->numSections > (m_file.GetSize() - sizeof(BinaryCacheHeader)) / sizeof(BinaryCacheSection))
+        {
+            Close();
+            return false;
+        }
+
+        const BinaryCacheSection *sections = (const BinaryCacheSection *)(header + 1);
+        uint64_t checksum = HASH_SEED;
+
+        for(uint64_t s=0; s<header->numSections; s++)
+        {
+            uint64_t size = m_file.GetSize();
+            if(sections[s].offset % BINARY_CACHE_ALIGNMENT != 0 || sections[s].offset > size ||
+               sections[s].elemSize == 0 ||
+               sections[s].count > (size - sections[s].offset) / sections[s].elemSize)
+            {
+                Close();
+                return false;
+            }
+
+            checksum = HashBytes(m_file.GetData() + sections[s].offset, 
+                                 (size_t)(sections[s].count * sections[s].elemSize), checksum);
+        }
+
+        if(checksum != header->checksum)
+        {
+            Close();
+            return false;
+        }
+
+        m_header = header;
+        m_sections = sections;
+        return true;
+    }
+
+    void Close()
+    {
+        m_file.Close();
+        m_header = NULL;
+        m_sections = NULL;
+    }
+
+    uint64_t GetKey() const { return m_header->key; }
+
+    /* Elements of section id, NULL if missing or of another element size */
+    template<class T>
+    const T *GetSection(uint32_t id, size_t &count) const
+    {
+        for(uint64_t s=0; s<m_header->numSections; s++)
+        {
+            if(m_sections[s].id != id)
+                continue;
+            if(m_sections[s].elemSize != sizeof(T))
+                return NULL;
+
+            count = (size_t)m_sections[s].count;
+            return (const T *)(m_file.GetData() + m_sections[s].offset);
+        }
+        return NULL;
+    }
+
+    /* Copies section id into values; fails unless it has count elements */
+    template<class T>
+    bool ReadSection(uint32_t id, size_t count, vector<T> &values) const
+    {
+        size_t n = 0;
+        const T *data = GetSection<T>(id, n);
+        if(!data || n != count)
+            return false;
+
+        values.assign(data, data + n);
+        return true;
+    }
+
+private:
+    MappedFile m_file;
+    const BinaryCacheHeader *m_header;
+    const BinaryCacheSection *m_sections;
+};
+
+#endif
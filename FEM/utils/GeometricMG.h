@@ -0,0 +1,171 @@
+/******************************************************************
+*
+* GeometricMG.h
+*
+* Description: 
+*
+* Geometric multigrid for the uniform triangle grids created by 
+* FEModel::CreateUniformGridMesh (nodes numbered row by row, every 
+* cell split along the diagonal from node (x,y) to node (x+1,y+1)).
+*
+* An axis with n >= 3 nodes is coarsened to n/2+1 nodes: every second
+* fine node, plus the last one if n is even. For odd n the coarse grid
+* is nested in the fine one; for even n the last coarse cell is only
+* one fine cell wide, so its diagonal cuts through fine triangles and
+* the coarse space is not exactly a subspace. Prolongation is linear 
+* interpolation on the coarse triangles in both cases; coarse operators
+* are formed as Galerkin products P^T*A*P (see Multigrid.h), which stay
+* symmetric positive definite. Coarsening continues until the system 
+* is small enough for the dense coarsest-level solve, so every grid 
+* gets a full hierarchy; 2^k+1 nodes per axis keep all levels nested.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __GEOMETRICMG_T_H__
+#define __GEOMETRICMG_T_H__
+
+#include "Multigrid.h"
+
+template<class T>
+class GeometricMultigridT : public MultigridT<T>
+{
+public:
+    GeometricMultigridT() 
+    {
+        m_nodesX = 0;
+        m_nodesY = 0;
+    }
+
+    /* Grid dimensions of the finest level, must be set before Setup() */
+    void SetGrid(int nodesX, int nodesY) 
+    {
+        m_nodesX = nodesX;
+        m_nodesY = nodesY;
+    }
+
+protected:
+    virtual void BuildHierarchy() 
+    {
+        int nx = m_nodesX;
+        int ny = m_nodesY;
+
+        if(nx * ny != this->GetCoarsestMatrix().numRows)
+            return;
+
+        while(nx * ny > this->GetMaxCoarseRows())
+        {
+            int cx = coarseSize(nx);
+            int cy = coarseSize(ny);
+            if(cx * cy == nx * ny)
+                break;
+
+            CSRMatrixT<T> P;
+            BuildProlongation(nx, ny, P);
+            this->AddCoarseLevel(P);
+
+            nx = cx;
+            ny = cy;
+        }
+    }
+
+private:
+    /* Nodes of a coarsened axis; axes shorter than 3 nodes are kept */
+    static int coarseSize(int n) 
+    {
+        return n >= 3 ? n / 2 + 1 : n;
+    }
+
+    /* Position of fine node i of an axis with n nodes on the coarse 
+       axis: coarse node c, or the midpoint of c and c+1 if mid */
+    static void coarsePosition(int n, int i, int &c, bool &mid) 
+    {
+        if(n < 3)
+        {
+            c = i;
+            mid = false;
+        }
+        else if(i == n - 1)
+        {
+            /* Last node, also for even n */
+            c = coarseSize(n) - 1;
+            mid = false;
+        }
+        else
+        {
+            c = i / 2;
+            mid = (i % 2 == 1);
+        }
+    }
+
+    /* Linear interpolation from the coarseSize(nx) x coarseSize(ny) grid */
+    static void BuildProlongation(int nx, int ny, CSRMatrixT<T> &P) 
+    {
+        int cx = coarseSize(nx);
+        int cy = coarseSize(ny);
+
+        P.numRows = nx * ny;
+        P.numCols = cx * cy;
+        P.rowPtr.assign(P.numRows + 1, 0);
+        P.colIdx.clear();
+        P.values.clear();
+
+        for(int y=0; y<ny; y++)
+        {
+            int iy;
+            bool midY;
+            coarsePosition(ny, y, iy, midY);
+
+            for(int x=0; x<nx; x++)
+            {
+                int ix;
+                bool midX;
+                coarsePosition(nx, x, ix, midX);
+
+                int c00 = iy * cx + ix;
+
+                if(!midX && !midY)
+                {
+                    /* Coinciding node */
+                    AddEntry(P, c00, 1);
+                }
+                else if(midX && !midY)
+                {
+                    /* Midpoint of a horizontal coarse edge */
+                    AddEntry(P, c00, 0.5);
+                    AddEntry(P, c00 + 1, 0.5);
+                }
+                else if(!midX && midY)
+                {
+                    /* Midpoint of a vertical coarse edge */
+                    AddEntry(P, c00, 0.5);
+                    AddEntry(P, c00 + cx, 0.5);
+                }
+                else
+                {
+                    /* Midpoint of the diagonal edge (x,y)-(x+1,y+1) */
+                    AddEntry(P, c00, 0.5);
+                    AddEntry(P, c00 + cx + 1, 0.5);
+                }
+
+                P.rowPtr[y * nx + x + 1] = (int)P.colIdx.size();
+            }
+        }
+    }
+
+    static void AddEntry(CSRMatrixT<T> &P, int col, T value) 
+    {
+        P.colIdx.push_back(col);
+        P.values.push_back(value);
+    }
+
+    int m_nodesX;
+    int m_nodesY;
+};
+
+#endif
@@ -0,0 +1,224 @@
+/******************************************************************
+*
+* GridOperator.h
+*
+* Description: 
+*
+* Matrix-free stiffness operator for the uniform triangle grids of 
+* FEModel::CreateUniformGridMesh (nodes numbered row by row, every cell
+* split into the triangles (00,10,11) and (00,11,01)). All triangles of
+* one kind share the same element stiffness matrix, so K*x is computed
+* on the fly from the grid dimensions and these two 3x3 matrices: 
+* interior rows use a precomputed 9-point stencil, rows on the domain
+* boundary sum over their existing adjacent triangles.
+*
+* Rows/columns can be masked (Dirichlet nodes): a masked row acts as 
+* identity and masked columns are dropped, matching the system produced 
+* by SparseSymmetricMatrixT::FixSolution.
+*
+* Provides GetNumRows/MultVector/GetDiagonal/GetProductBytes, the 
+* interface used by SparseLinSolverPCGT with the Jacobi preconditioner.
+* Memory is O(n).
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __GRIDOPERATOR_T_H__
+#define __GRIDOPERATOR_T_H__
+
+#include <vector>
+
+using std::vector;
+
+template<class T>
+class UniformGridOperatorT
+{
+public:
+    UniformGridOperatorT() 
+    {
+        m_nodesX = 0;
+        m_nodesY = 0;
+    }
+
+    /* kLower/kUpper: element stiffness of the triangles (00,10,11) and 
+       (00,11,01), local node order as listed */
+    void Setup(int nodesX, int nodesY, const T kLower[3][3], const T kUpper[3][3]) 
+    {
+        m_nodesX = nodesX;
+        m_nodesY = nodesY;
+
+        for(int a=0; a<3; a++)
+        {
+            for(int b=0; b<3; b++)
+            {
+                m_k[0][a][b] = kLower[a][b];
+                m_k[1][a][b] = kUpper[a][b];
+            }
+        }
+
+        /* Interior stencil: accumulate the six adjacent triangles */
+        for(int dy=0; dy<3; dy++)
+            for(int dx=0; dx<3; dx++)
+                m_stencil[dy][dx] = 0;
+
+        for(int cy=-1; cy<=0; cy++)
+        {
+            for(int cx=-1; cx<=0; cx++)
+            {
+                for(int t=0; t<2; t++)
+                {
+                    for(int a=0; a<3; a++)
+                    {
+                        if(cx + s_offset[t][a][0] != 0 || cy + s_offset[t][a][1] != 0)
+                            continue;
+
+                        for(int b=0; b<3; b++)
+                            m_stencil[cy + s_offset[t][b][1] + 1][cx + s_offset[t][b][0] + 1] += m_k[t][a][b];
+                    }
+                }
+            }
+        }
+
+        m_mask.assign(GetNumRows(), 0);
+    }
+
+    /* mask[i] != 0 marks a Dirichlet row/column */
+    void SetMask(const vector<char> &mask) { m_mask = mask; }
+    void ClearMask() { m_mask.assign(GetNumRows(), 0); }
+
+    int GetNumRows() const { return m_nodesX * m_nodesY; }
+
+    /* Estimated memory traffic of MultVector: mask, the masked copy of 
+       x written and read, x and b */
+    double GetProductBytes() const 
+    {
+        return (double)GetNumRows() * (2 * sizeof(char) + 4 * sizeof(T));
+    }
+
+    /* b = K*x of the masked system */
+    void MultVector(const vector<T> &x, vector<T> &b) const 
+    {
+        int n = GetNumRows();
+
+        m_masked.resize(n);
+        for(int i=0; i<n; i++)
+            m_masked[i] = m_mask[i] ? T(0) : x[i];
+
+        MultVectorUnmasked(m_masked, b);
+
+        for(int i=0; i<n; i++)
+            if(m_mask[i])
+                b[i] = x[i];
+    }
+
+    /* b = K*x of the full (unmodified) stiffness matrix */
+    void MultVectorUnmasked(const vector<T> &x, vector<T> &b) const 
+    {
+        int nx = m_nodesX;
+        int ny = m_nodesY;
+
+#pragma omp parallel for schedule(static)
+        for(int y=0; y<ny; y++)
+        {
+            for(int xi=0; xi<nx; xi++)
+            {
+                int i = y * nx + xi;
+
+                if(xi == 0 || y == 0 || xi == nx - 1 || y == ny - 1)
+                {
+                    b[i] = BoundaryRow(xi, y, x);
+                    continue;
+                }
+
+                T sum = 0;
+                for(int dy=-1; dy<=1; dy++)
+                    for(int dx=-1; dx<=1; dx++)
+                        sum += m_stencil[dy + 1][dx + 1] * x[i + dy * nx + dx];
+                b[i] = sum;
+            }
+        }
+    }
+
+    void GetDiagonal(vector<T> &diag) const 
+    {
+        int n = GetNumRows();
+        diag.resize(n);
+
+        vector<T> unit(n, T(0));
+        for(int y=0; y<m_nodesY; y++)
+        {
+            for(int xi=0; xi<m_nodesX; xi++)
+            {
+                int i = y * m_nodesX + xi;
+
+                if(m_mask[i])
+                    diag[i] = 1;
+                else if(xi == 0 || y == 0 || xi == m_nodesX - 1 || y == m_nodesY - 1)
+                {
+                    unit[i] = 1;
+                    diag[i] = BoundaryRow(xi, y, unit);
+                    unit[i] = 0;
+                }
+                else
+                    diag[i] = m_stencil[1][1];
+            }
+        }
+    }
+
+private:
+    /* Row of node (xi, y) summed over the triangles that exist */
+    T BoundaryRow(int xi, int y, const vector<T> &x) const 
+    {
+        T sum = 0;
+
+        for(int cy=y-1; cy<=y; cy++)
+        {
+            for(int cx=xi-1; cx<=xi; cx++)
+            {
+                if(cx < 0 || cy < 0 || cx >= m_nodesX - 1 || cy >= m_nodesY - 1)
+                    continue;
+
+                for(int t=0; t<2; t++)
+                {
+                    for(int a=0; a<3; a++)
+                    {
+                        if(cx + s_offset[t][a][0] != xi || cy + s_offset[t][a][1] != y)
+                            continue;
+
+                        for(int b=0; b<3; b++)
+                        {
+                            int j = (cy + s_offset[t][b][1]) * m_nodesX + cx + s_offset[t][b][0];
+                            sum += m_k[t][a][b] * x[j];
+                        }
+                    }
+                }
+            }
+        }
+
+        return sum;
+    }
+
+    /* Local node positions (dx, dy) relative to the cell origin */
+    static const int s_offset[2][3][2];
+
+    int m_nodesX;
+    int m_nodesY;
+    T m_k[2][3][3];
+    T m_stencil[3][3];
+
+    vector<char> m_mask;
+    mutable vector<T> m_masked;
+};
+
+template<class T>
+const int UniformGridOperatorT<T>::s_offset[2][3][2] = {
+    { { 0, 0 }, { 1, 0 }, { 1, 1 } },
+    { { 0, 0 }, { 1, 1 }, { 0, 1 } }
+};
+
+#endif
@@ -0,0 +1,262 @@
+/******************************************************************
+*
+* LagrangeTriangle.h
+*
+* Description:
+*
+* Triangle elements with Lagrange shape functions of polynomial order
+* ORDER (1: linear, 2: quadratic, 3: cubic), fixed at compile time.
+* Local node a sits at the barycentric coordinates index / ORDER
+* given by GetNodeIndex(): the three corners first, then the nodes on
+* the edges (v0, v1), (v1, v2), (v2, v0), each ordered from the first
+* corner of the edge to the second, then the interior nodes. For P2
+* nodes 3, 4 and 5 are the edge midpoints.
+*
+* The shape functions are products of one-dimensional Lagrange
+* polynomials in the barycentric coordinates (Silvester):
+*
+*   N_(i,j,k) = P_i(l0) P_j(l1) P_k(l2),
+*   P_n(l) = prod_{s<n} (ORDER * l - s) / (s + 1)
+*
+* An object holds reference-element tables: the shape functions at the
+* points of a quadrature rule for load vectors and errors, and for the
+* stiffness matrix the integrals of dN_a/dl_m * dN_b/dl_n. On an affine
+* element the stiffness matrix is then
+*
+*   K_ab = area * sum_{m,n} S_ab^mn (grad l_m . grad l_n)
+*
+* so only the three linear basis gradients of the element (as kept by
+* TriangleMesh) are needed, no quadrature per element.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __LAGRANGETRIANGLE_H__
+#define __LAGRANGETRIANGLE_H__
+
+#include <algorithm>
+#include <cassert>
+
+#include "TriangleQuadrature.h"
+#include "Vec2.h"
+
+template<int ORDER>
+class LagrangeTriangleT
+{
+public:
+    static const int NUM_NODES = (ORDER + 1) * (ORDER + 2) / 2;
+
+    /* Entries of a symmetric element matrix, lower triangle by rows:
+       (a, b) with a >= b is entry a * (a + 1) / 2 + b */
+    static const int NUM_PAIRS = NUM_NODES * (NUM_NODES + 1) / 2;
+
+    static const int NODES_PER_EDGE = ORDER - 1;
+
+    /* Tables for load vectors integrated with the Gauss rule of the
+       given degree; the stiffness matrix is always exact */
+    LagrangeTriangleT(int loadDegree)
+    {
+        m_rule = GetTriangleQuadrature(loadDegree);
+        assert(m_rule.numPoints <= MAX_POINTS);
+
+        for(int q=0; q<m_rule.numPoints; q++)
+            EvaluateShape(m_rule.points[q], m_shape[q]);
+
+        /* grad N_a . grad N_b is of degree 2 * (ORDER - 1) */
+        TriangleQuadrature rule = GetTriangleQuadrature(std::max(2 * (ORDER - 1), 1));
+
+        std::fill(&m_stiffness[0][0], &m_stiffness[0][0] + NUM_PAIRS * 6, 0.0);
+        for(int q=0; q<rule.numPoints; q++)
+        {
+            double dN[NUM_NODES][3];
+            EvaluateShapeDeriv(rule.points[q], dN);
+
+            for(int a=0; a<NUM_NODES; a++)
+            {
+                for(int b=0; b<=a; b++)
+                {
+                    double *s = m_stiffness[a * (a + 1) / 2 + b];
+                    for(int k=0; k<6; k++)
+                    {
+                        int m = gradientPair(k, 0);
+                        int n = gradientPair(k, 1);
+
+                        double value = dN[a][m] * dN[b][n];
+                        if(m != n)
+                            value += dN[a][n] * dN[b][m];
+                        s[k] += rule.weights[q] * value;
+                    }
+                }
+            }
+        }
+    }
+
+    /* Barycentric position of local node a, times ORDER */
+    static void GetNodeIndex(int a, int index[3])
+    {
+        index[0] = index[1] = index[2] = 0;
+
+        if(a < 3)
+        {
+            index[a] = ORDER;
+            return;
+        }
+
+        a -= 3;
+        if(a < 3 * NODES_PER_EDGE)
+        {
+            int edge = a / NODES_PER_EDGE;
+            int s = a % NODES_PER_EDGE + 1;
+            index[edge] = ORDER - s;
+            index[(edge + 1) % 3] = s;
+            return;
+        }
+
+        a -= 3 * NODES_PER_EDGE;
+        for(int i=1; i<ORDER; i++)
+        {
+            for(int j=1; i + j<ORDER; j++)
+            {
+                if(a-- == 0)
+                {
+                    index[0] = i;
+                    index[1] = j;
+                    index[2] = ORDER - i - j;
+                    return;
+                }
+            }
+        }
+        assert(false);
+    }
+
+    static void EvaluateShape(const double l[3], double N[NUM_NODES])
+    {
+        for(int a=0; a<NUM_NODES; a++)
+        {
+            int index[3];
+            GetNodeIndex(a, index);
+
+            N[a] = lagrange(index[0], l[0]) * lagrange(index[1], l[1]) * lagrange(index[2], l[2]);
+        }
+    }
+
+    /* Derivatives with respect to the barycentric coordinates */
+    static void EvaluateShapeDeriv(const double l[3], double dN[NUM_NODES][3])
+    {
+        for(int a=0; a<NUM_NODES; a++)
+        {
+            int index[3];
+            GetNodeIndex(a, index);
+
+            double p[3], dp[3];
+            for(int m=0; m<3; m++)
+            {
+                p[m] = lagrange(index[m], l[m]);
+                dp[m] = lagrangeDeriv(index[m], l[m]);
+            }
+
+            dN[a][0] = dp[0] * p[1] * p[2];
+            dN[a][1] = p[0] * dp[1] * p[2];
+            dN[a][2] = p[0] * p[1] * dp[2];
+        }
+    }
+
+    /* Element stiffness matrix from the gradients of the three linear
+       basis functions (see TriangleMesh::ComputeGeometry) */
+    void ComputeStiffness(double area, const double gradX[3], const double gradY[3],
+                          double stiffness[NUM_PAIRS]) const
+    {
+        double g[6];
+        for(int k=0; k<6; k++)
+        {
+            int m = gradientPair(k, 0);
+            int n = gradientPair(k, 1);
+            g[k] = area * (gradX[m] * gradX[n] + gradY[m] * gradY[n]);
+        }
+
+        for(int p=0; p<NUM_PAIRS; p++)
+        {
+            const double *s = m_stiffness[p];
+            stiffness[p] = s[0] * g[0] + s[1] * g[1] + s[2] * g[2] +
+                           s[3] * g[3] + s[4] * g[4] + s[5] * g[5];
+        }
+    }
+
+    /* Integrals of source * N_a over the triangle (p0, p1, p2), divided
+       by its area */
+    template<class Function>
+    void ComputeLoad(Function source, const Vector2 &p0, const Vector2 &p1, const Vector2 &p2,
+                     double load[NUM_NODES]) const
+    {
+        std::fill(load, load + NUM_NODES, 0.0);
+
+        for(int q=0; q<m_rule.numPoints; q++)
+        {
+            const double *l = m_rule.points[q];
+            double x = l[0] * p0[0] + l[1] * p1[0] + l[2] * p2[0];
+            double y = l[0] * p0[1] + l[1] * p1[1] + l[2] * p2[1];
+
+            double fw = m_rule.weights[q] * source(x, y);
+            for(int a=0; a<NUM_NODES; a++)
+                load[a] += fw * m_shape[q][a];
+        }
+    }
+
+    /* Quadrature rule of the tables and the shape functions at its points */
+    const TriangleQuadrature &GetRule() const { return m_rule; }
+    const double *GetShape(int q) const { return m_shape[q]; }
+
+    /* Local nodes of entry p of a symmetric element matrix */
+    static void GetPair(int p, int &a, int &b)
+    {
+        a = 0;
+        while((a + 1) * (a + 2) / 2 <= p)
+            a++;
+        b = p - a * (a + 1) / 2;
+    }
+
+private:
+    static const int MAX_POINTS = 7;
+
+    TriangleQuadrature m_rule;
+    double m_shape[MAX_POINTS][NUM_NODES];
+
+    /* Coefficients of (grad l_m . grad l_n) for the pairs of gradientPair */
+    double m_stiffness[NUM_PAIRS][6];
+
+    static int gradientPair(int k, int which)
+    {
+        static const int pairs[6][2] = { { 0, 0 }, { 1, 1 }, { 2, 2 }, { 1, 0 }, { 2, 0 }, { 2, 1 } };
+        return pairs[k][which];
+    }
+
+    /* P_n(l) and its derivative */
+    static double lagrange(int n, double l)
+    {
+        double p = 1.0;
+        for(int s=0; s<n; s++)
+            p *= (ORDER * l - s) / (s + 1);
+        return p;
+    }
+
+    static double lagrangeDeriv(int n, double l)
+    {
+        double dp = 0.0;
+        for(int t=0; t<n; t++)
+        {
+            double p = (double)ORDER / (t + 1);
+            for(int s=0; s<n; s++)
+                if(s != t)
+                    p *= (ORDER * l - s) / (s + 1);
+            dp += p;
+        }
+        return dp;
+    }
+};
+
+#endif
@@ -0,0 +1,79 @@
+/******************************************************************
+*
+* MappedFile.h
+*
+* Description: Read-only memory mapping of a whole file (POSIX mmap). 
+* The mapping is released with Close() or by the destructor.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __MAPPEDFILE_H__
+#define __MAPPEDFILE_H__
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class MappedFile
+{
+public:
+    MappedFile() : m_data(NULL), m_size(0) {}
+    ~MappedFile() { Close(); }
+
+    bool Open(const char *filename)
+    {
+        Close();
+
+        int fd = open(filename, O_RDONLY);
+        if(fd < 0)
+            return false;
+
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if(data == MAP_FAILED)
+            return false;
+
+        /* Users read the contents front to back */
+        madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+        m_data = (const char *)data;
+        m_size = (size_t)st.st_size;
+        return true;
+    }
+
+    void Close()
+    {
+        if(m_data)
+            munmap((void *)m_data, m_size);
+        m_data = NULL;
+        m_size = 0;
+    }
+
+    const char *GetData() const { return m_data; }
+    size_t GetSize() const { return m_size; }
+
+private:
+    const char *m_data;
+    size_t m_size;
+
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+};
+
+#endif
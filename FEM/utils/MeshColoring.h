@@ -0,0 +1,109 @@
+/******************************************************************
+*
+* MeshColoring.h
+*
+* Description: 
+*
+* Greedy coloring of mesh elements: two elements sharing a node never
+* get the same color, so all elements of one color class can scatter
+* into global matrices/vectors concurrently without locks or atomics.
+* Elements are stored grouped by color, ascending element index within
+* each class; walking this schedule in order gives a fixed summation
+* order independent of the number of threads.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __MESHCOLORING_H__
+#define __MESHCOLORING_H__
+
+#include <vector>
+
+using std::vector;
+
+class MeshColoring
+{
+public:
+    MeshColoring() : m_colorPtr(1, 0) {}
+
+    /* conn holds nodesPerElem global node IDs for each of numElems 
+       elements */
+    void Compute(const int *conn, int numElems, int nodesPerElem, int numNodes) 
+    {
+        /* Node -> element adjacency in compressed form */
+        vector<int> nodePtr(numNodes + 1, 0);
+        for(int k=0; k<numElems*nodesPerElem; k++)
+            nodePtr[conn[k] + 1]++;
+        for(int i=0; i<numNodes; i++)
+            nodePtr[i + 1] += nodePtr[i];
+
+        vector<int> nodeElems(nodePtr[numNodes]);
+        vector<int> fill(nodePtr.begin(), nodePtr.end() - 1);
+        for(int e=0; e<numElems; e++)
+            for(int j=0; j<nodesPerElem; j++)
+                nodeElems[fill[conn[e*nodesPerElem + j]]++] = e;
+
+        /* Greedy: smallest color not used by an already colored neighbor;
+           forbidden[c] == e marks color c as taken for element e */
+        vector<int> color(numElems, -1);
+        vector<int> forbidden;
+        int numColors = 0;
+
+        for(int e=0; e<numElems; e++)
+        {
+            for(int j=0; j<nodesPerElem; j++)
+            {
+                int node = conn[e*nodesPerElem + j];
+                for(int k=nodePtr[node]; k<nodePtr[node + 1]; k++)
+                {
+                    int c = color[nodeElems[k]];
+                    if(c >= 0)
+                        forbidden[c] = e;
+                }
+            }
+
+            int c = 0;
+            while(c < numColors && forbidden[c] == e)
+                c++;
+
+            if(c == numColors)
+            {
+                numColors++;
+                forbidden.push_back(-1);
+            }
+            color[e] = c;
+        }
+
+        /* Group elements by color */
+        m_colorPtr.assign(numColors + 1, 0);
+        for(int e=0; e<numElems; e++)
+            m_colorPtr[color[e] + 1]++;
+        for(int c=0; c<numColors; c++)
+            m_colorPtr[c + 1] += m_colorPtr[c];
+
+        m_elements.resize(numElems);
+        fill.assign(m_colorPtr.begin(), m_colorPtr.end() - 1);
+        for(int e=0; e<numElems; e++)
+            m_elements[fill[color[e]]++] = e;
+    }
+
+    int GetNumColors() const { return (int)m_colorPtr.size() - 1; }
+
+    /* Schedule positions [GetColorBegin(c), GetColorEnd(c)) hold color c */
+    int GetColorBegin(int c) const { return m_colorPtr[c]; }
+    int GetColorEnd(int c) const { return m_colorPtr[c + 1]; }
+
+    int GetNumElements() const { return (int)m_elements.size(); }
+    int GetElement(int pos) const { return m_elements[pos]; }
+
+private:
+    vector<int> m_colorPtr;
+    vector<int> m_elements;
+};
+
+#endif
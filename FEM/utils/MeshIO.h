@@ -0,0 +1,745 @@
+/******************************************************************
+*
+* MeshIO.h
+*
+* Description:
+*
+* Importers for meshes from external generators, filling a TriangleMesh
+* including the node boundary markers:
+*
+* ReadTriangleMesh: Shewchuk's Triangle, files <base>.node and <base>.ele
+*   plus <base>.poly if present. Node markers come from the .node file,
+*   segment markers of the .poly file are added to the segment end
+*   points. Numbering may start at 0 or 1; second-order (6 node)
+*   triangles are reduced to their corners.
+* ReadGmshMesh: Gmsh .msh format version 4.1, ASCII or binary. Nodes
+*   classified on curves or points, and the nodes of line elements, are
+*   marked with the tag of their entity. Triangles and quadrangles (split
+*   in two) of any order are reduced to their corners; other elements
+*   are skipped.
+*
+* Unused nodes are removed. If the file has no boundary information, the
+* nodes on edges with a single adjacent triangle are marked instead.
+*
+* Files are memory-mapped and read in place by MeshTokenizer, which
+* parses numbers without copying or allocating (only doubles with more
+* than 15 significant digits go through strtod on a stack buffer).
+* All functions return false on I/O or format errors.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __MESHIO_H__
+#define __MESHIO_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "TriangleMesh.h"
+
+using std::vector;
+
+/*----------------------------------------------------------------*/
+/* Cursor over a text (or mixed text/binary) buffer. Errors are sticky:
+   after the first malformed token all reads return 0 and IsValid() is
+   false, so callers check once per block. In binary mode NextInt() reads
+   a 4-byte int, NextSize() an 8-byte unsigned and NextDouble() an 8-byte
+   double in host byte order. */
+class MeshTokenizer
+{
+public:
+    MeshTokenizer(const char *begin, const char *end, char comment = 0)
+    {
+        m_cur = begin;
+        m_end = end;
+        m_comment = comment;
+        m_binary = false;
+        m_valid = true;
+    }
+
+    void SetBinary(bool binary) { m_binary = binary; }
+
+    bool IsValid() const { return m_valid; }
+
+    /* Upper bound for any count read from the file */
+    size_t GetRemaining() const { return (size_t)(m_end - m_cur); }
+
+    /* True if only whitespace and comments are left */
+    bool AtEnd()
+    {
+        skipSpace();
+        return m_cur == m_end;
+    }
+
+    long long NextInt()
+    {
+        if(m_binary)
+        {
+            int32_t v = 0;
+            readRaw(&v, sizeof(v));
+            return v;
+        }
+        return parseInt();
+    }
+
+    size_t NextSize()
+    {
+        if(m_binary)
+        {
+            uint64_t v = 0;
+            readRaw(&v, sizeof(v));
+            return (size_t)v;
+        }
+
+        long long v = parseInt();
+        if(v < 0)
+            return fail();
+        return (size_t)v;
+    }
+
+    double NextDouble()
+    {
+        if(m_binary)
+        {
+            double v = 0;
+            readRaw(&v, sizeof(v));
+            return v;
+        }
+        return parseDouble();
+    }
+
+    /* Next whitespace-delimited token equals word (always text) */
+    bool NextWord(const char *word)
+    {
+        const char *begin;
+        size_t len = nextToken(begin);
+        return len == strlen(word) && memcmp(begin, word, len) == 0;
+    }
+
+    /* Next token, which must be shorter than size, copied to buffer */
+    bool NextWord(char *buffer, size_t size)
+    {
+        const char *begin;
+        size_t len = nextToken(begin);
+        if(len == 0 || len >= size)
+            return false;
+
+        memcpy(buffer, begin, len);
+        buffer[len] = 0;
+        return true;
+    }
+
+    /* Moves behind the next line break */
+    void SkipLine()
+    {
+        const char *p = (const char *)memchr(m_cur, '\n', m_end - m_cur);
+        m_cur = p ? p + 1 : m_end;
+    }
+
+    /* Moves behind the next occurrence of text */
+    bool SkipPast(const char *text)
+    {
+        size_t len = strlen(text);
+        const char *p = m_cur;
+
+        while(p + len <= m_end)
+        {
+            p = (const char *)memchr(p, text[0], m_end - p - len + 1);
+            if(!p)
+                break;
+            if(memcmp(p, text, len) == 0)
+            {
+                m_cur = p + len;
+                return true;
+            }
+            p++;
+        }
+
+        m_cur = m_end;
+        return false;
+    }
+
+private:
+    const char *m_cur;
+    const char *m_end;
+    char m_comment;
+    bool m_binary;
+    bool m_valid;
+
+    int fail()
+    {
+        m_valid = false;
+        m_cur = m_end;
+        return 0;
+    }
+
+    static bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+    void skipSpace()
+    {
+        while(m_cur < m_end)
+        {
+            if(isSpace(*m_cur))
+                m_cur++;
+            else if(m_comment && *m_cur == m_comment)
+                SkipLine();
+            else
+                break;
+        }
+    }
+
+    size_t nextToken(const char *&begin)
+    {
+        skipSpace();
+        begin = m_cur;
+        while(m_cur < m_end && !isSpace(*m_cur))
+            m_cur++;
+        return (size_t)(m_cur - begin);
+    }
+
+    /* A number must be followed by whitespace, a comment or the end */
+    bool endOfToken(const char *p) const
+    {
+        return p == m_end || isSpace(*p) || (m_comment && *p == m_comment);
+    }
+
+    void readRaw(void *dst, size_t bytes)
+    {
+        if((size_t)(m_end - m_cur) < bytes)
+        {
+            fail();
+            return;
+        }
+        memcpy(dst, m_cur, bytes);
+        m_cur += bytes;
+    }
+
+    long long parseInt()
+    {
+        skipSpace();
+
+        const char *p = m_cur;
+        bool negative = false;
+        if(p < m_end && (*p == '-' || *p == '+'))
+            negative = (*p++ == '-');
+
+        const char *digits = p;
+        long long v = 0;
+        while(p < m_end && isDigit(*p) && p - digits < 18)
+            v = 10 * v + (*p++ - '0');
+
+        if(p == digits || !endOfToken(p))
+            return fail();
+
+        m_cur = p;
+        return negative ? -v : v;
+    }
+
+    /* Decimal mantissa and exponent are accumulated exactly; with at most
+       15 significant digits and |exponent| <= 22 one multiplication or
+       division by an exact power of ten gives the correctly rounded
+       result (Clinger's fast path), otherwise strtod takes over. */
+    double parseDouble()
+    {
+        static const double powers[23] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+        skipSpace();
+
+        const char *begin = m_cur;
+        const char *p = begin;
+        bool negative = false;
+        if(p < m_end && (*p == '-' || *p == '+'))
+            negative = (*p++ == '-');
+
+        uint64_t mantissa = 0;
+        int numSignificant = 0;
+        int exponent = 0;
+        bool anyDigit = false;
+
+        for(; p < m_end && isDigit(*p); p++)
+        {
+            anyDigit = true;
+            if(numSignificant < 19)
+            {
+                mantissa = 10 * mantissa + (*p - '0');
+                if(mantissa)
+                    numSignificant++;
+            }
+            else
+                exponent++;
+        }
+
+        if(p < m_end && *p == '.')
+        {
+            for(p++; p < m_end && isDigit(*p); p++)
+            {
+                anyDigit = true;
+                if(numSignificant < 19)
+                {
+                    mantissa = 10 * mantissa + (*p - '0');
+                    if(mantissa)
+                        numSignificant++;
+                    exponent--;
+                }
+            }
+        }
+
+        if(!anyDigit)
+            return fail();
+
+        if(p < m_end && (*p == 'e' || *p == 'E'))
+        {
+            p++;
+            bool negativeExp = false;
+            if(p < m_end && (*p == '-' || *p == '+'))
+                negativeExp = (*p++ == '-');
+
+            const char *expDigits = p;
+            int e = 0;
+            while(p < m_end && isDigit(*p))
+            {
+                if(e < 10000)
+                    e = 10 * e + (*p - '0');
+                p++;
+            }
+
+            if(p == expDigits)
+                return fail();
+            exponent += negativeExp ? -e : e;
+        }
+
+        if(!endOfToken(p))
+            return fail();
+
+        m_cur = p;
+
+        if(numSignificant <= 15 && exponent >= -22 && exponent <= 22)
+        {
+            double v = (double)mantissa;
+            v = exponent < 0 ? v / powers[-exponent] : v * powers[exponent];
+            return negative ? -v : v;
+        }
+
+        char buffer[64];
+        size_t len = (size_t)(p - begin);
+        if(len >= sizeof(buffer))
+            return fail();
+
+        memcpy(buffer, begin, len);
+        buffer[len] = 0;
+        return strtod(buffer, NULL);
+    }
+};
+
+/*----------------------------------------------------------------*/
+/* Shared final step of the importers */
+inline void FinishMeshImport(TriangleMesh &mesh, bool hasMarkers)
+{
+    mesh.RemoveUnusedNodes();
+
+    if(!hasMarkers)
+        mesh.MarkBoundaryNodes();
+
+    mesh.UpdateGeometry();
+}
+
+/*----------------------------------------------------------------*/
+/* basename without extension, e.g. "square.1" for square.1.node */
+inline bool ReadTriangleMesh(const char *basename, TriangleMesh &mesh)
+{
+    std::string base(basename);
+    bool hasMarkers = false;
+
+    mesh.Clear();
+
+    /* .node: <#vertices> <dimension> <#attributes> <#markers (0/1)>,
+       then <id> <x> <y> [attributes] [marker] */
+    MappedFile nodeFile;
+    if(!nodeFile.Open((base + ".node").c_str()))
+        return false;
+
+    MeshTokenizer nodes(nodeFile.GetData(), nodeFile.GetData() + nodeFile.GetSize(), '#');
+
+    long long numNodes = nodes.NextInt();
+    long long dim = nodes.NextInt();
+    long long numAttribs = nodes.NextInt();
+    long long numMarkers = nodes.NextInt();
+
+    if(!nodes.IsValid() || dim != 2 || numNodes < 3 || numAttribs < 0 ||
+       (size_t)numNodes > nodes.GetRemaining())
+        return false;
+
+    long long firstID = 0;
+    for(long long i=0; i<numNodes; i++)
+    {
+        long long id = nodes.NextInt();
+        if(i == 0)
+            firstID = id;
+
+        double x = nodes.NextDouble();
+        double y = nodes.NextDouble();
+
+        for(long long a=0; a<numAttribs; a++)
+            nodes.NextDouble();
+
+        int marker = numMarkers > 0 ? (int)nodes.NextInt() : 0;
+        hasMarkers |= (marker != 0);
+
+        if(id != firstID + i)
+            return false;
+
+        mesh.AddNode(Vector2(x, y), marker);
+    }
+
+    if(!nodes.IsValid() || (firstID != 0 && firstID != 1))
+        return false;
+
+    nodeFile.Close();
+
+    /* .ele: <#triangles> <nodes per triangle> <#attributes>,
+       then <id> <nodes> [attributes] */
+    MappedFile eleFile;
+    if(!eleFile.Open((base + ".ele").c_str()))
+        return false;
+
+    MeshTokenizer eles(eleFile.GetData(), eleFile.GetData() + eleFile.GetSize(), '#');
+
+    long long numTris = eles.NextInt();
+    long long nodesPerTri = eles.NextInt();
+    numAttribs = eles.NextInt();
+
+    if(!eles.IsValid() || numTris < 1 || (nodesPerTri != 3 && nodesPerTri != 6) ||
+       numAttribs < 0 || (size_t)numTris > eles.GetRemaining())
+        return false;
+
+    mesh.Reserve((int)numNodes, (int)numTris);
+
+    for(long long t=0; t<numTris; t++)
+    {
+        eles.NextInt();
+
+        long long ids[6];
+        for(int a=0; a<nodesPerTri; a++)
+        {
+            ids[a] = eles.NextInt() - firstID;
+            if(ids[a] < 0 || ids[a] >= numNodes)
+                return false;
+        }
+
+        for(long long a=0; a<numAttribs; a++)
+            eles.NextDouble();
+
+        mesh.AddTriangle((int)ids[0], (int)ids[1], (int)ids[2]);
+    }
+
+    if(!eles.IsValid())
+        return false;
+
+    eleFile.Close();
+
+    /* .poly (optional): a vertex section like .node, usually empty, then
+       <#segments> <#markers (0/1)> and <id> <node> <node> [marker] */
+    MappedFile polyFile;
+    if(polyFile.Open((base + ".poly").c_str()))
+    {
+        MeshTokenizer poly(polyFile.GetData(), polyFile.GetData() + polyFile.GetSize(), '#');
+
+        long long numPolyNodes = poly.NextInt();
+        poly.NextInt();
+        numAttribs = poly.NextInt();
+        long long numPolyMarkers = poly.NextInt();
+
+        if(!poly.IsValid() || numPolyNodes < 0 || numAttribs < 0 ||
+           (size_t)numPolyNodes > poly.GetRemaining())
+            return false;
+
+        for(long long i=0; i<numPolyNodes; i++)
+        {
+            poly.NextInt();
+            poly.NextDouble();
+            poly.NextDouble();
+            for(long long a=0; a<numAttribs + (numPolyMarkers > 0 ? 1 : 0); a++)
+                poly.NextDouble();
+        }
+
+        long long numSegments = poly.NextInt();
+        long long numSegMarkers = poly.NextInt();
+
+        if(!poly.IsValid() || numSegments < 0 || (size_t)numSegments > poly.GetRemaining())
+            return false;
+
+        for(long long s=0; s<numSegments; s++)
+        {
+            poly.NextInt();
+            long long a = poly.NextInt() - firstID;
+            long long b = poly.NextInt() - firstID;
+            int marker = numSegMarkers > 0 ? (int)poly.NextInt() : 1;
+
+            if(a < 0 || a >= numNodes || b < 0 || b >= numNodes)
+                return false;
+
+            if(marker != 0)
+            {
+                if(mesh.GetNodeMarker((int)a) == 0)
+                    mesh.SetNodeMarker((int)a, marker);
+                if(mesh.GetNodeMarker((int)b) == 0)
+                    mesh.SetNodeMarker((int)b, marker);
+                hasMarkers = true;
+            }
+        }
+
+        /* Holes and regional attributes follow; not needed here */
+        if(!poly.IsValid())
+            return false;
+    }
+
+    FinishMeshImport(mesh, hasMarkers);
+    return true;
+}
+
+/*----------------------------------------------------------------*/
+/* Number of nodes of Gmsh element types, 0 if unknown */
+inline int GmshNodesPerElement(int type)
+{
+    switch(type)
+    {
+        case 1:  return 2;  /* line */
+        case 2:  return 3;  /* triangle */
+        case 3:  return 4;  /* quadrangle */
+        case 4:  return 4;  /* tetrahedron */
+        case 5:  return 8;  /* hexahedron */
+        case 6:  return 6;  /* prism */
+        case 7:  return 5;  /* pyramid */
+        case 8:  return 3;  /* second-order line */
+        case 9:  return 6;  /* second-order triangle */
+        case 10: return 9;  /* second-order quadrangle */
+        case 11: return 10; /* second-order tetrahedron */
+        case 15: return 1;  /* point */
+        case 16: return 8;  /* serendipity quadrangle */
+        case 20: return 9;  /* incomplete third-order triangle */
+        case 21: return 10; /* third-order triangle */
+        case 26: return 4;  /* third-order line */
+        default: return 0;
+    }
+}
+
+inline bool ReadGmshMesh(const char *filename, TriangleMesh &mesh)
+{
+    MappedFile file;
+    if(!file.Open(filename))
+        return false;
+
+    MeshTokenizer tok(file.GetData(), file.GetData() + file.GetSize());
+
+    mesh.Clear();
+
+    bool haveFormat = false;
+    bool binary = false;
+    bool haveNodes = false;
+    bool hasMarkers = false;
+
+    vector<int> tagToNode; /* Node tag - minNodeTag -> node ID */
+    size_t minNodeTag = 0;
+
+    char section[64];
+    while(!tok.AtEnd())
+    {
+        if(!tok.NextWord(section, sizeof(section)) || section[0] != '$')
+            return false;
+
+        if(strcmp(section, "$MeshFormat") == 0)
+        {
+            /* <version> <file type: 0 ASCII, 1 binary> <sizeof(size_t)> */
+            double version = tok.NextDouble();
+            long long fileType = tok.NextInt();
+            long long dataSize = tok.NextInt();
+
+            if(!tok.IsValid() || version < 4.1 || version >= 5.0 ||
+               (fileType != 0 && fileType != 1) || dataSize != 8)
+                return false;
+
+            binary = (fileType == 1);
+            if(binary)
+            {
+                /* Binary one for the byte order check */
+                tok.SkipLine();
+                tok.SetBinary(true);
+                if(tok.NextInt() != 1)
+                    return false;
+                tok.SetBinary(false);
+            }
+
+            if(!tok.NextWord("$EndMeshFormat"))
+                return false;
+
+            haveFormat = true;
+        }
+        else if(strcmp(section, "$Nodes") == 0 && haveFormat)
+        {
+            /* <#blocks> <#nodes> <min tag> <max tag>, per block
+               <entity dim> <entity tag> <parametric> <#nodes>, the node
+               tags, then x y z (and parametric coordinates) per node */
+            tok.SkipLine();
+            tok.SetBinary(binary);
+
+            size_t numBlocks = tok.NextSize();
+            size_t numNodes = tok.NextSize();
+            minNodeTag = tok.NextSize();
+            size_t maxNodeTag = tok.NextSize();
+
+            if(!tok.IsValid() || numNodes > tok.GetRemaining() || numNodes > INT32_MAX ||
+               maxNodeTag < minNodeTag || maxNodeTag - minNodeTag > INT32_MAX)
+                return false;
+
+            tagToNode.assign(numNodes ? maxNodeTag - minNodeTag + 1 : 0, -1);
+
+            for(size_t b=0; b<numBlocks; b++)
+            {
+                long long entityDim = tok.NextInt();
+                long long entityTag = tok.NextInt();
+                long long parametric = tok.NextInt();
+                size_t blockSize = tok.NextSize();
+
+                if(!tok.IsValid() || blockSize > tok.GetRemaining() ||
+                   entityDim < 0 || entityDim > 3)
+                    return false;
+
+                int firstID = mesh.GetNumNodes();
+
+                for(size_t i=0; i<blockSize; i++)
+                {
+                    size_t tag = tok.NextSize();
+                    if(tag < minNodeTag || tag > maxNodeTag)
+                        return false;
+                    tagToNode[tag - minNodeTag] = firstID + (int)i;
+                }
+
+                /* Nodes on curves and points lie on the boundary of a 2D domain */
+                int marker = entityDim < 2 ? (int)entityTag : 0;
+                hasMarkers |= (marker != 0);
+
+                int numParams = parametric ? (int)entityDim : 0;
+                for(size_t i=0; i<blockSize; i++)
+                {
+                    double x = tok.NextDouble();
+                    double y = tok.NextDouble();
+                    tok.NextDouble();
+                    for(int p=0; p<numParams; p++)
+                        tok.NextDouble();
+
+                    mesh.AddNode(Vector2(x, y), marker);
+                }
+
+                if(!tok.IsValid())
+                    return false;
+            }
+
+            tok.SetBinary(false);
+            if(!tok.NextWord("$EndNodes") || mesh.GetNumNodes() != (int)numNodes)
+                return false;
+
+            haveNodes = true;
+        }
+        else if(strcmp(section, "$Elements") == 0 && haveNodes)
+        {
+            /* <#blocks> <#elements> <min tag> <max tag>, per block
+               <entity dim> <entity tag> <type> <#elements>, then per
+               element its tag and node tags */
+            tok.SkipLine();
+            tok.SetBinary(binary);
+
+            size_t numBlocks = tok.NextSize();
+            size_t numElems = tok.NextSize();
+            tok.NextSize();
+            tok.NextSize();
+
+            if(!tok.IsValid() || numElems > tok.GetRemaining())
+                return false;
+
+            for(size_t b=0; b<numBlocks; b++)
+            {
+                tok.NextInt();
+                long long entityTag = tok.NextInt();
+                int type = (int)tok.NextInt();
+                size_t blockSize = tok.NextSize();
+
+                int nodesPerElem = GmshNodesPerElement(type);
+                if(!tok.IsValid() || nodesPerElem == 0 || blockSize > tok.GetRemaining())
+                    return false;
+
+                bool isLine = (type == 1 || type == 8 || type == 26);
+                bool isTri = (type == 2 || type == 9 || type == 20 || type == 21);
+                bool isQuad = (type == 3 || type == 10 || type == 16);
+
+                for(size_t e=0; e<blockSize; e++)
+                {
+                    tok.NextSize();
+
+                    int ids[10];
+                    for(int a=0; a<nodesPerElem; a++)
+                    {
+                        size_t tag = tok.NextSize();
+                        if(tag < minNodeTag || tag - minNodeTag >= tagToNode.size() ||
+                           tagToNode[tag - minNodeTag] < 0)
+                            return false;
+                        ids[a] = tagToNode[tag - minNodeTag];
+                    }
+
+                    if(isTri)
+                        mesh.AddTriangle(ids[0], ids[1], ids[2]);
+                    else if(isQuad)
+                    {
+                        mesh.AddTriangle(ids[0], ids[1], ids[2]);
+                        mesh.AddTriangle(ids[0], ids[2], ids[3]);
+                    }
+                    else if(isLine && entityTag != 0)
+                    {
+                        /* Corner nodes; inner nodes of curved lines are dropped */
+                        mesh.SetNodeMarker(ids[0], (int)entityTag);
+                        mesh.SetNodeMarker(ids[1], (int)entityTag);
+                        hasMarkers = true;
+                    }
+                }
+
+                if(!tok.IsValid())
+                    return false;
+            }
+
+            tok.SetBinary(false);
+            if(!tok.NextWord("$EndElements"))
+                return false;
+        }
+        else
+        {
+            /* Entities, physical names, periodicity, data: not needed */
+            std::string end = std::string("$End") + (section + 1);
+            if(!tok.SkipPast(end.c_str()))
+                return false;
+        }
+    }
+
+    if(mesh.GetNumTriangles() == 0)
+        return false;
+
+    FinishMeshImport(mesh, hasMarkers);
+    return true;
+}
+
+#endif
@@ -0,0 +1,196 @@
+/******************************************************************
+*
+* MixedPrecision.h
+*
+* Description: 
+*
+* Mixed-precision iterative refinement: the system is stored a second 
+* time in single precision and every correction is computed by float
+* PCG on that copy, which halves the traffic of values and vectors in
+* the inner iterations (column indices stay 32 bit). The outer loop computes the residual r = b - A*x in 
+* double precision and accumulates x += e, so the final accuracy is 
+* that of a double solve:
+*
+*   r = b - A*x
+*   while |r| > tolerance
+*       solve A_float * e = r / |r|  (float PCG, relative tolerance)
+*       x += |r| * e,  r = b - A*x
+*
+* |r| is the diagonally scaled norm sqrt(r^T diag(A)^-1 r), i.e. the
+* convergence test of the Jacobi-preconditioned double solve. The 
+* right-hand side of the inner solve is normalized so that its 
+* tolerance is relative and independent of the float range.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __MIXEDPRECISION_T_H__
+#define __MIXEDPRECISION_T_H__
+
+#include <cmath>
+#include <vector>
+
+#include "PCGT.h"
+#include "SolverStats.h"
+#include "SparseSymMat.h"
+
+using std::vector;
+
+template<class Preconditioner = JacobiPreconditionerT<float> >
+class MixedPrecisionSolverT
+{
+public:
+    MixedPrecisionSolverT() 
+    {
+        m_innerTolerance = 1e-4;
+        m_maxRefinements = 20;
+        m_reuse = false;
+        m_generation = 0;
+    }
+
+    /* The float solver, e.g. to configure its preconditioner or variant */
+    SparseLinSolverPCGT<float, Preconditioner> &GetInnerSolver() { return m_inner; }
+
+    /* Residual reduction asked from every inner solve */
+    void SetInnerTolerance(double tolerance) { m_innerTolerance = tolerance; }
+    void SetMaxRefinements(int maxRefinements) { m_maxRefinements = maxRefinements; }
+
+    /* With reuse enabled the float copy and the preconditioner are kept
+       while later solves use the same matrix, i.e. the same generation
+       (see SparseSymmetricMatrixT::GetGeneration) */
+    void SetReuse(bool reuse) { m_reuse = reuse; }
+    void Reset() { m_generation = 0; }
+
+    /* residual: tolerance of the scaled double residual norm
+       maxIterations: limit of inner iterations over all refinements 
+                      (-1: no limit) */
+    const SolverStats &SolveLinearSystem(SparseSymmetricMatrixT<double> &matA, 
+                                         vector<double> &x, const vector<double> &b, 
+                                         double residual, int maxIterations) 
+    {
+        SolverTimer total;
+        SolverTimer timer;
+
+        matA.Finalize();
+        const SparseSymmetricMatrixT<double> &A = matA;
+        int n = A.GetNumRows();
+
+        m_stats.Reset();
+
+        if(!m_reuse || m_generation != A.GetGeneration() || m_lowA.GetNumRows() != n)
+        {
+            m_lowA.ConvertFrom(A);
+
+            A.GetDiagonal(m_invDiag);
+            for(int i=0; i<n; i++)
+                m_invDiag[i] = 1 / m_invDiag[i];
+
+            /* The new copy has a new generation: the inner solver sets up
+               its preconditioner again */
+            m_inner.SetPreconditionerReuse(true);
+            m_generation = A.GetGeneration();
+        }
+        m_stats.timeSetup = timer.Lap();
+
+        vector<double> r(n);
+        vector<float> rLow(n);
+        vector<float> eLow(n);
+
+        double norm = ComputeResidual(A, x, b, r);
+
+        while(m_stats.refinements < m_maxRefinements)
+        {
+            if(norm <= residual)
+            {
+                m_stats.converged = true;
+                break;
+            }
+
+            int left = maxIterations == -1 ? -1 : maxIterations - m_stats.iterations;
+            if(left == 0)
+                break;
+
+            for(int i=0; i<n; i++)
+            {
+                rLow[i] = (float)(r[i] / norm);
+                eLow[i] = 0;
+            }
+
+            const SolverStats &inner = m_inner.SolveLinearSystem(m_lowA, eLow, rLow, 
+                                                                 (float)m_innerTolerance, left);
+            AddInnerStats(inner);
+
+            timer.Lap();
+            for(int i=0; i<n; i++)
+                x[i] += norm * eLow[i];
+            m_stats.timeUpdate += timer.Lap();
+
+            norm = ComputeResidual(A, x, b, r);
+            m_stats.refinements++;
+        }
+
+        if(norm <= residual)
+            m_stats.converged = true;
+
+        m_stats.timeTotal = total.Lap();
+        return m_stats;
+    }
+
+    const SolverStats &GetStats() const { return m_stats; }
+
+private:
+    SparseSymmetricMatrixT<float> m_lowA;
+    SparseLinSolverPCGT<float, Preconditioner> m_inner;
+    vector<double> m_invDiag;
+
+    double m_innerTolerance;
+    int m_maxRefinements;
+    bool m_reuse;
+    uint64_t m_generation; /* Of the matrix m_lowA was converted from */
+
+    SolverStats m_stats;
+
+    /* r = b - A*x in double precision; records and returns |r| */
+    double ComputeResidual(const SparseSymmetricMatrixT<double> &A, const vector<double> &x, 
+                           const vector<double> &b, vector<double> &r) 
+    {
+        SolverTimer timer;
+        int n = (int)r.size();
+
+        A.MultVector(x, r);
+        m_stats.timeSpMV += timer.Lap();
+        m_stats.bytesSpMV += A.GetProductBytes();
+
+        double norm = 0;
+        for(int i=0; i<n; i++)
+        {
+            r[i] = b[i] - r[i];
+            norm += r[i] * r[i] * m_invDiag[i];
+        }
+        m_stats.timeReduce += timer.Lap();
+        m_stats.bytesVector += 4.0 * n * sizeof(double);
+
+        norm = sqrt(norm);
+        m_stats.residuals.push_back(norm);
+        return norm;
+    }
+
+    void AddInnerStats(const SolverStats &inner) 
+    {
+        m_stats.iterations += inner.iterations;
+        m_stats.timeSetup += inner.timeSetup;
+        m_stats.timeSpMV += inner.timeSpMV;
+        m_stats.timePrecond += inner.timePrecond;
+        m_stats.timeReduce += inner.timeReduce;
+        m_stats.timeUpdate += inner.timeUpdate;
+        m_stats.bytesSpMV += inner.bytesSpMV;
+        m_stats.bytesVector += inner.bytesVector;
+    }
+};
+
+#endif
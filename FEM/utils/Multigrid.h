@@ -0,0 +1,535 @@
+/******************************************************************
+*
+* Multigrid.h
+*
+* Description: 
+*
+* Common multigrid machinery: a general CSR matrix type with the sparse
+* products needed for Galerkin coarse operators (A_c = P^T*A*P), and a
+* multigrid hierarchy with V-cycle. Derived classes only decide how the
+* prolongation P of every level is built (geometric or algebraic).
+*
+* The V-cycle uses damped Jacobi or Gauss-Seidel smoothing (forward
+* before, backward after the coarse-grid correction, so the cycle is a
+* symmetric operator) and a dense Cholesky solve on the coarsest level.
+* It can be used stand-alone via Solve() or as preconditioner policy of
+* SparseLinSolverPCGT via Setup()/Apply().
+*
+* Rows that are decoupled from all others (e.g. Dirichlet rows after
+* FixSolution) are excluded from the coarse grids.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __MULTIGRID_T_H__
+#define __MULTIGRID_T_H__
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "SparseSymMat.h"
+
+using std::vector;
+
+/*----------------------------------------------------------------*/
+/* General (unsymmetric) compressed-row matrix */
+template<class T>
+class CSRMatrixT
+{
+public:
+    CSRMatrixT() 
+    {
+        numRows = 0;
+        numCols = 0;
+        rowPtr.assign(1, 0);
+    }
+
+    /* Expands a finalized symmetric matrix to both triangles */
+    void FromSymmetric(const SparseSymmetricMatrixT<T> &matA) 
+    {
+        numRows = numCols = matA.GetNumRows();
+
+        const vector<int> &lowerPtr = matA.GetRowPtr();
+        const vector<int> &lowerCol = matA.GetColIdx();
+        const vector<T> &lowerVal = matA.GetValues();
+
+        rowPtr.assign(numRows + 1, 0);
+        for(int i=0; i<numRows; i++)
+        {
+            for(int k=lowerPtr[i]; k<lowerPtr[i + 1]; k++)
+            {
+                rowPtr[i + 1]++;
+                if(lowerCol[k] != i)
+                    rowPtr[lowerCol[k] + 1]++;
+            }
+        }
+        for(int i=0; i<numRows; i++)
+            rowPtr[i + 1] += rowPtr[i];
+
+        colIdx.resize(rowPtr[numRows]);
+        values.resize(rowPtr[numRows]);
+
+        /* Rows ascending: upper entries (j, i) of row j arrive with 
+           increasing i, after the lower part written below */
+        vector<int> fill(rowPtr.begin(), rowPtr.end() - 1);
+        for(int i=0; i<numRows; i++)
+        {
+            for(int k=lowerPtr[i]; k<lowerPtr[i + 1]; k++)
+            {
+                int j = lowerCol[k];
+
+                colIdx[fill[i]] = j;
+                values[fill[i]++] = lowerVal[k];
+
+                if(j != i)
+                {
+                    colIdx[fill[j]] = i;
+                    values[fill[j]++] = lowerVal[k];
+                }
+            }
+        }
+    }
+
+    /* y = A*x */
+    void Mult(const vector<T> &x, vector<T> &y) const 
+    {
+#pragma omp parallel for schedule(static)
+        for(int i=0; i<numRows; i++)
+        {
+            T sum = 0;
+            for(int k=rowPtr[i]; k<rowPtr[i + 1]; k++)
+                sum += values[k] * x[colIdx[k]];
+            y[i] = sum;
+        }
+    }
+
+    /* y = A^T*x */
+    void MultTranspose(const vector<T> &x, vector<T> &y) const 
+    {
+        std::fill(y.begin(), y.begin() + numCols, T(0));
+
+        for(int i=0; i<numRows; i++)
+            for(int k=rowPtr[i]; k<rowPtr[i + 1]; k++)
+                y[colIdx[k]] += values[k] * x[i];
+    }
+
+    T GetDiagonal(int i) const 
+    {
+        for(int k=rowPtr[i]; k<rowPtr[i + 1]; k++)
+            if(colIdx[k] == i)
+                return values[k];
+        return 0;
+    }
+
+    void Transpose(CSRMatrixT &result) const 
+    {
+        result.numRows = numCols;
+        result.numCols = numRows;
+        result.rowPtr.assign(numCols + 1, 0);
+
+        for(int k=0; k<rowPtr[numRows]; k++)
+            result.rowPtr[colIdx[k] + 1]++;
+        for(int j=0; j<numCols; j++)
+            result.rowPtr[j + 1] += result.rowPtr[j];
+
+        result.colIdx.resize(rowPtr[numRows]);
+        result.values.resize(rowPtr[numRows]);
+
+        vector<int> fill(result.rowPtr.begin(), result.rowPtr.end() - 1);
+        for(int i=0; i<numRows; i++)
+        {
+            for(int k=rowPtr[i]; k<rowPtr[i + 1]; k++)
+            {
+                int pos = fill[colIdx[k]]++;
+                result.colIdx[pos] = i;
+                result.values[pos] = values[k];
+            }
+        }
+    }
+
+    /* result = A*B, using a dense accumulator per row */
+    static void Multiply(const CSRMatrixT &A, const CSRMatrixT &B, CSRMatrixT &result) 
+    {
+        result.numRows = A.numRows;
+        result.numCols = B.numCols;
+        result.rowPtr.assign(A.numRows + 1, 0);
+        result.colIdx.clear();
+        result.values.clear();
+
+        vector<int> marker(B.numCols, -1);
+        vector<T> accum(B.numCols, T(0));
+        vector<int> rowCols;
+
+        for(int i=0; i<A.numRows; i++)
+        {
+            rowCols.clear();
+
+            for(int ka=A.rowPtr[i]; ka<A.rowPtr[i + 1]; ka++)
+            {
+                int j = A.colIdx[ka];
+                T a = A.values[ka];
+
+                for(int kb=B.rowPtr[j]; kb<B.rowPtr[j + 1]; kb++)
+                {
+                    int col = B.colIdx[kb];
+                    if(marker[col] != i)
+                    {
+                        marker[col] = i;
+                        accum[col] = 0;
+                        rowCols.push_back(col);
+                    }
+                    accum[col] += a * B.values[kb];
+                }
+            }
+
+            std::sort(rowCols.begin(), rowCols.end());
+            for(int k=0; k<(int)rowCols.size(); k++)
+            {
+                result.colIdx.push_back(rowCols[k]);
+                result.values.push_back(accum[rowCols[k]]);
+            }
+            result.rowPtr[i + 1] = (int)result.colIdx.size();
+        }
+    }
+
+    int numRows;
+    int numCols;
+    vector<int> rowPtr;
+    vector<int> colIdx;
+    vector<T> values;
+};
+
+/*----------------------------------------------------------------*/
+enum MultigridSmoother 
+{
+    MG_SMOOTH_JACOBI,        /* Damped Jacobi, weight 2/3 */
+    MG_SMOOTH_GAUSS_SEIDEL   /* Forward sweeps down, backward sweeps up */
+};
+
+template<class T>
+class MultigridT
+{
+public:
+    MultigridT() 
+    {
+        m_smoother = MG_SMOOTH_GAUSS_SEIDEL;
+        m_numSweeps = 1;
+        m_maxCoarseRows = 1000;
+    }
+
+    virtual ~MultigridT() {}
+
+    void SetSmoother(MultigridSmoother smoother, int numSweeps) 
+    {
+        m_smoother = smoother;
+        m_numSweeps = numSweeps;
+    }
+
+    /* Coarsening stops at (or below) this many unknowns; the coarsest 
+       level is solved with a dense Cholesky factorization */
+    void SetMaxCoarseRows(int maxCoarseRows) { m_maxCoarseRows = maxCoarseRows; }
+
+    int GetNumLevels() const { return (int)m_levels.size(); }
+    int GetNumRows(int level) const { return m_levels[level].A.numRows; }
+
+    /* Preconditioner interface: builds the hierarchy for matA */
+    void Setup(const SparseSymmetricMatrixT<T> &matA) 
+    {
+        m_levels.clear();
+        m_levels.push_back(Level());
+        m_levels[0].A.FromSymmetric(matA);
+
+        BuildHierarchy();
+        FinishSetup();
+    }
+
+    /* Preconditioner interface: one V-cycle with zero initial guess */
+    void Apply(const vector<T> &r, vector<T> &z) const 
+    {
+        std::fill(z.begin(), z.end(), T(0));
+        VCycle(0, r, z);
+    }
+
+    /* Stand-alone solver: V-cycles until the residual norm drops below
+       residual; returns the number of cycles */
+    int Solve(const SparseSymmetricMatrixT<T> &matA, vector<T> &x, 
+              const vector<T> &b, T residual, int maxCycles) 
+    {
+        Setup(matA);
+
+        const CSRMatrixT<T> &A = m_levels[0].A;
+        int n = A.numRows;
+        vector<T> r(n);
+
+        int cycle = 0;
+        while(maxCycles == -1 || cycle < maxCycles)
+        {
+            A.Mult(x, r);
+            T norm = 0;
+            for(int i=0; i<n; i++)
+            {
+                r[i] = b[i] - r[i];
+                norm += r[i] * r[i];
+            }
+            if(sqrt(norm) <= residual)
+                break;
+
+            VCycle(0, b, x);
+            cycle++;
+        }
+
+        return cycle;
+    }
+
+protected:
+    /* Appends coarser levels; implemented by geometric/algebraic variants
+       via AddCoarseLevel(). The finest level is m_levels[0]. */
+    virtual void BuildHierarchy() = 0;
+
+    /* P maps the current coarsest level to a new coarser one, given as
+       rows(P) = fine unknowns, cols(P) = coarse unknowns */
+    void AddCoarseLevel(CSRMatrixT<T> &P) 
+    {
+        Level &fine = m_levels.back();
+
+        /* Decoupled rows (Dirichlet) do not take part in the coarse grid */
+        for(int i=0; i<P.numRows; i++)
+        {
+            if(IsDecoupled(fine.A, i))
+                for(int k=P.rowPtr[i]; k<P.rowPtr[i + 1]; k++)
+                    P.values[k] = 0;
+        }
+
+        Level coarse;
+        CSRMatrixT<T> AP;
+        CSRMatrixT<T>::Multiply(fine.A, P, AP);
+
+        fine.P = P;
+        P.Transpose(fine.R);
+        CSRMatrixT<T>::Multiply(fine.R, AP, coarse.A);
+
+        /* Coarse unknowns without fine support get an identity row */
+        for(int i=0; i<coarse.A.numRows; i++)
+        {
+            bool hasDiag = false;
+            for(int k=coarse.A.rowPtr[i]; k<coarse.A.rowPtr[i + 1]; k++)
+            {
+                if(coarse.A.colIdx[k] == i && coarse.A.values[k] != 0)
+                    hasDiag = true;
+            }
+            if(!hasDiag)
+                SetIdentityRow(coarse.A, i);
+        }
+
+        m_levels.push_back(coarse);
+    }
+
+    const CSRMatrixT<T> &GetCoarsestMatrix() const { return m_levels.back().A; }
+
+    int GetMaxCoarseRows() const { return m_maxCoarseRows; }
+
+    static bool IsDecoupled(const CSRMatrixT<T> &A, int i) 
+    {
+        for(int k=A.rowPtr[i]; k<A.rowPtr[i + 1]; k++)
+            if(A.colIdx[k] != i && A.values[k] != 0)
+                return false;
+        return true;
+    }
+
+private:
+    struct Level
+    {
+        CSRMatrixT<T> A;
+        CSRMatrixT<T> P; /* Prolongation from the next coarser level */
+        CSRMatrixT<T> R; /* Restriction, P^T */
+        vector<T> invDiag;
+
+        /* Work vectors of the V-cycle */
+        mutable vector<T> r;
+        mutable vector<T> bc;
+        mutable vector<T> xc;
+    };
+
+    static void SetIdentityRow(CSRMatrixT<T> &A, int i) 
+    {
+        /* Only called for rows whose coarse support vanished: all their 
+           entries are zero, so the row can simply be made diagonal. The 
+           diagonal is part of the pattern unless the row is empty. */
+        bool found = false;
+        for(int k=A.rowPtr[i]; k<A.rowPtr[i + 1]; k++)
+        {
+            if(A.colIdx[k] == i)
+            {
+                A.values[k] = 1;
+                found = true;
+            }
+            else
+                A.values[k] = 0;
+        }
+
+        if(!found)
+        {
+            int pos = A.rowPtr[i + 1];
+            A.colIdx.insert(A.colIdx.begin() + pos, i);
+            A.values.insert(A.values.begin() + pos, T(1));
+            for(int j=i+1; j<=A.numRows; j++)
+                A.rowPtr[j]++;
+        }
+    }
+
+    void FinishSetup() 
+    {
+        for(int l=0; l<(int)m_levels.size(); l++)
+        {
+            Level &level = m_levels[l];
+            int n = level.A.numRows;
+
+            level.invDiag.resize(n);
+            for(int i=0; i<n; i++)
+                level.invDiag[i] = 1 / level.A.GetDiagonal(i);
+
+            level.r.resize(n);
+            if(l + 1 < (int)m_levels.size())
+            {
+                level.bc.resize(m_levels[l + 1].A.numRows);
+                level.xc.resize(m_levels[l + 1].A.numRows);
+            }
+        }
+
+        /* Dense Cholesky of the coarsest operator, if small enough */
+        const CSRMatrixT<T> &Ac = m_levels.back().A;
+        int n = Ac.numRows;
+
+        m_coarseFactor.clear();
+        if(n > m_maxCoarseRows)
+            return;
+
+        m_coarseFactor.assign(n * n, T(0));
+        for(int i=0; i<n; i++)
+            for(int k=Ac.rowPtr[i]; k<Ac.rowPtr[i + 1]; k++)
+                m_coarseFactor[i * n + Ac.colIdx[k]] = Ac.values[k];
+
+        for(int j=0; j<n; j++)
+        {
+            T d = m_coarseFactor[j * n + j];
+            for(int k=0; k<j; k++)
+                d -= m_coarseFactor[j * n + k] * m_coarseFactor[j * n + k];
+            d = sqrt(std::max(d, T(0)));
+            m_coarseFactor[j * n + j] = d;
+
+            for(int i=j+1; i<n; i++)
+            {
+                T s = m_coarseFactor[i * n + j];
+                for(int k=0; k<j; k++)
+                    s -= m_coarseFactor[i * n + k] * m_coarseFactor[j * n + k];
+                m_coarseFactor[i * n + j] = d > 0 ? s / d : 0;
+            }
+        }
+    }
+
+    void CoarseSolve(const vector<T> &b, vector<T> &x) const 
+    {
+        const Level &level = m_levels.back();
+        int n = level.A.numRows;
+
+        if(m_coarseFactor.empty())
+        {
+            /* Too large for a dense factorization: smooth thoroughly */
+            for(int s=0; s<20; s++)
+            {
+                Smooth(level, b, x, true);
+                Smooth(level, b, x, false);
+            }
+            return;
+        }
+
+        for(int i=0; i<n; i++)
+        {
+            T s = b[i];
+            for(int k=0; k<i; k++)
+                s -= m_coarseFactor[i * n + k] * x[k];
+            x[i] = s / m_coarseFactor[i * n + i];
+        }
+        for(int i=n-1; i>=0; i--)
+        {
+            T s = x[i];
+            for(int k=i+1; k<n; k++)
+                s -= m_coarseFactor[k * n + i] * x[k];
+            x[i] = s / m_coarseFactor[i * n + i];
+        }
+    }
+
+    /* One smoothing sweep on A*x = b; forward selects the Gauss-Seidel
+       direction (Jacobi is direction independent) */
+    void Smooth(const Level &level, const vector<T> &b, vector<T> &x, bool forward) const 
+    {
+        const CSRMatrixT<T> &A = level.A;
+        int n = A.numRows;
+
+        if(m_smoother == MG_SMOOTH_JACOBI)
+        {
+            A.Mult(x, level.r);
+            for(int i=0; i<n; i++)
+                x[i] += T(2) / T(3) * level.invDiag[i] * (b[i] - level.r[i]);
+            return;
+        }
+
+        for(int step=0; step<n; step++)
+        {
+            int i = forward ? step : n - 1 - step;
+
+            T sum = b[i];
+            for(int k=A.rowPtr[i]; k<A.rowPtr[i + 1]; k++)
+                if(A.colIdx[k] != i)
+                    sum -= A.values[k] * x[A.colIdx[k]];
+
+            x[i] = sum * level.invDiag[i];
+        }
+    }
+
+    void VCycle(int l, const vector<T> &b, vector<T> &x) const 
+    {
+        if(l == (int)m_levels.size() - 1)
+        {
+            CoarseSolve(b, x);
+            return;
+        }
+
+        const Level &level = m_levels[l];
+        int n = level.A.numRows;
+
+        for(int s=0; s<m_numSweeps; s++)
+            Smooth(level, b, x, true);
+
+        /* Restrict residual, solve for the correction on the coarser grid */
+        level.A.Mult(x, level.r);
+        for(int i=0; i<n; i++)
+            level.r[i] = b[i] - level.r[i];
+
+        level.R.Mult(level.r, level.bc);
+        std::fill(level.xc.begin(), level.xc.end(), T(0));
+        VCycle(l + 1, level.bc, level.xc);
+
+        level.P.Mult(level.xc, level.r);
+        for(int i=0; i<n; i++)
+            x[i] += level.r[i];
+
+        for(int s=0; s<m_numSweeps; s++)
+            Smooth(level, b, x, false);
+    }
+
+    MultigridSmoother m_smoother;
+    int m_numSweeps;
+    int m_maxCoarseRows;
+
+    vector<Level> m_levels;
+    vector<T> m_coarseFactor; /* Dense lower Cholesky factor, row-major */
+};
+
+#endif
@@ -0,0 +1,172 @@
+/******************************************************************
+*
+* NodeOrdering.h
+*
+* Description: Node renumberings that improve memory locality of 
+* sparse matrix operations. Both return perm with perm[new] = old.
+*
+* ReverseCuthillMcKee: bandwidth reduction on the node graph (given in
+*   compressed adjacency form); breadth-first search from a 
+*   pseudo-peripheral node, neighbors by increasing degree, reversed.
+* MortonOrdering: sorts nodes along a Z-order space-filling curve 
+*   through their 2D positions.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __NODEORDERING_H__
+#define __NODEORDERING_H__
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "Vec2.h"
+
+using std::vector;
+
+/*----------------------------------------------------------------*/
+/* Breadth-first levels from start; returns the last node reached and 
+   the number of levels. Only unvisited nodes (visited[i] == 0) count. */
+inline int BreadthFirstLevels(const vector<int> &adjPtr, const vector<int> &adj, 
+                              const vector<char> &visited, int start, int &numLevels)
+{
+    int n = (int)adjPtr.size() - 1;
+    vector<int> level(n, -1);
+    vector<int> queue(1, start);
+    level[start] = 0;
+
+    int last = start;
+    for(int head=0; head<(int)queue.size(); head++)
+    {
+        int v = queue[head];
+        last = v;
+        for(int k=adjPtr[v]; k<adjPtr[v + 1]; k++)
+        {
+            int u = adj[k];
+            if(!visited[u] && level[u] < 0)
+            {
+                level[u] = level[v] + 1;
+                queue.push_back(u);
+            }
+        }
+    }
+
+    numLevels = level[last] + 1;
+    return last;
+}
+
+inline void ReverseCuthillMcKee(const vector<int> &adjPtr, const vector<int> &adj, 
+                                vector<int> &perm)
+{
+    int n = (int)adjPtr.size() - 1;
+
+    vector<char> visited(n, 0);
+    vector<std::pair<int, int> > nbrs;
+    perm.clear();
+    perm.reserve(n);
+
+    for(int seed=0; seed<n; seed++)
+    {
+        if(visited[seed])
+            continue;
+
+        /* Pseudo-peripheral node of this component: repeat BFS from the
+           farthest node while the number of levels grows */
+        int start = seed;
+        int numLevels = 0;
+        int far = BreadthFirstLevels(adjPtr, adj, visited, start, numLevels);
+        for(int iter=0; iter<8; iter++)
+        {
+            int farLevels = 0;
+            int next = BreadthFirstLevels(adjPtr, adj, visited, far, farLevels);
+            if(farLevels <= numLevels)
+                break;
+
+            start = far;
+            numLevels = farLevels;
+            far = next;
+        }
+
+        /* Cuthill-McKee from start */
+        int head = (int)perm.size();
+        perm.push_back(start);
+        visited[start] = 1;
+
+        for(; head<(int)perm.size(); head++)
+        {
+            int v = perm[head];
+
+            nbrs.clear();
+            for(int k=adjPtr[v]; k<adjPtr[v + 1]; k++)
+            {
+                int u = adj[k];
+                if(!visited[u])
+                {
+                    nbrs.push_back(std::make_pair(adjPtr[u + 1] - adjPtr[u], u));
+                    visited[u] = 1;
+                }
+            }
+
+            std::sort(nbrs.begin(), nbrs.end());
+            for(int k=0; k<(int)nbrs.size(); k++)
+                perm.push_back(nbrs[k].second);
+        }
+    }
+
+    std::reverse(perm.begin(), perm.end());
+}
+
+/*----------------------------------------------------------------*/
+/* Spreads the lower 16 bits of v to the even bit positions */
+inline unsigned int SpreadBits(unsigned int v)
+{
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+inline void MortonOrdering(const vector<Vector2> &pos, vector<int> &perm)
+{
+    int n = (int)pos.size();
+    perm.clear();
+    if(n == 0)
+        return;
+
+    double minX = pos[0].x(), maxX = pos[0].x();
+    double minY = pos[0].y(), maxY = pos[0].y();
+    for(int i=1; i<n; i++)
+    {
+        minX = std::min(minX, pos[i].x());
+        maxX = std::max(maxX, pos[i].x());
+        minY = std::min(minY, pos[i].y());
+        maxY = std::max(maxY, pos[i].y());
+    }
+
+    double scaleX = maxX > minX ? 65535.0 / (maxX - minX) : 0.0;
+    double scaleY = maxY > minY ? 65535.0 / (maxY - minY) : 0.0;
+
+    vector<std::pair<unsigned int, int> > keys(n);
+    for(int i=0; i<n; i++)
+    {
+        unsigned int qx = (unsigned int)((pos[i].x() - minX) * scaleX);
+        unsigned int qy = (unsigned int)((pos[i].y() - minY) * scaleY);
+        keys[i] = std::make_pair(SpreadBits(qx) | (SpreadBits(qy) << 1), i);
+    }
+
+    std::sort(keys.begin(), keys.end());
+
+    perm.resize(n);
+    for(int i=0; i<n; i++)
+        perm[i] = keys[i].second;
+}
+
+#endif
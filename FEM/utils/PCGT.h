@@ -2,12 +2,46 @@
 *
 * PCGT.h
 *
-* Description: Code implements a diagonally preconditioned conjugate 
-* gradient solver.
+* Description: Code implements a preconditioned conjugate gradient 
+* solver. The preconditioner is a policy template parameter (see 
+* Preconditioners.h); the default is diagonal (Jacobi) preconditioning.
 *
 * Solves linear system A*x = b for unknown vector x. 
 * Matrix A must be symmetric and positive-definite.
 *
+* Besides SparseSymmetricMatrixT any operator type can be used that 
+* provides GetNumRows(), MultVector(x, b) and whatever the chosen 
+* preconditioner needs (GetDiagonal(diag) for Jacobi), e.g. the 
+* matrix-free UniformGridOperatorT. For the telemetry the operator also
+* reports GetProductBytes(), the estimated memory traffic of a product.
+*
+* The solver is silent. Every solve fills a SolverStats record 
+* (iterations, residual history, time per phase, bandwidth), returned 
+* by SolveLinearSystem and available through GetStats(); an optional
+* callback is invoked after every iteration.
+*
+* SolveMultiple() solves for several right-hand sides at once; the 
+* vectors are stored interleaved so that every matrix entry is read 
+* once per iteration and applied to all of them.
+*
+* Three variants of the iteration are available (SetVariant):
+*   PCG_STANDARD  - textbook loop, one pass per vector operation
+*   PCG_FUSED     - same recurrences, vector updates and reductions 
+*                   merged into as few sweeps as possible; with the 
+*                   Jacobi preconditioner the scaling is fused as well
+*   PCG_PIPELINED - Ghysels/Vanroose pipelined CG: one fused sweep with 
+*                   a single reduction per iteration, independent of the
+*                   preconditioner apply and product that follow it. 
+*                   Needs more vectors and rounding accumulates slightly
+*                   differently. With OpenMP the reduction still ends in
+*                   the barrier of the sweep, so nothing is overlapped
+*                   and it streams more memory than PCG_FUSED; kept for
+*                   comparison, not as the default.
+*
+* P. Ghysels, W. Vanroose, "Hiding global synchronization latency in 
+* the preconditioned Conjugate Gradient algorithm", Parallel Computing 
+* 40(7), 2014.
+*
 * From: Jonathan Richard Shewchuk, "An Introduction to the Conjugate 
 * Gradient Method Without the Agonizing Pain"
 * http://www.cs.cmu.edu/~quake-papers/painless-conjugate-gradient.pdf
@@ -23,92 +57,755 @@
 #ifndef __PCGT_T_H__
 #define __PCGT_T_H__
 
-#include <iostream>
+#include <cmath>
 #include <vector>
 
 #include "Vec2.h"
 #include "Vec3.h"
 #include "SparseSymMat.h"
+#include "Preconditioners.h"
+#include "SolverStats.h"
 
 using namespace std;
 
-template<class T>
+enum PCGVariant
+{
+    PCG_STANDARD,
+    PCG_FUSED,
+    PCG_PIPELINED
+};
+
+/* Called after every iteration with the preconditioned residual norm */
+typedef void (*PCGCallback)(int iteration, double residual, void *userData);
+
+template<class T, class Preconditioner = JacobiPreconditionerT<T> >
 class SparseLinSolverPCGT
 {
 public:
 
+    SparseLinSolverPCGT() 
+    {
+        m_reusePrecond = false;
+        m_precondReady = false;
+        m_precondRows = 0;
+        m_precondGeneration = 0;
+        m_variant = PCG_STANDARD;
+        m_callback = NULL;
+        m_callbackData = NULL;
+    }
+
+    void SetVariant(PCGVariant variant) { m_variant = variant; }
+    PCGVariant GetVariant() const { return m_variant; }
+
+    Preconditioner &GetPreconditioner() { return m_precond; }
+
+    /* With reuse enabled the preconditioner is set up by the first solve
+       only and kept while later solves use the same matrix: same 
+       GetGeneration() for SparseSymmetricMatrixT, same size for other 
+       operators, where the caller has to call ResetPreconditioner() if 
+       their values change. */
+    void SetPreconditionerReuse(bool reuse) { m_reusePrecond = reuse; }
+    void ResetPreconditioner() { m_precondReady = false; }
+
+    void SetCallback(PCGCallback callback, void *userData) 
+    {
+        m_callback = callback;
+        m_callbackData = userData;
+    }
+
+    /* Record of the last solve */
+    const SolverStats &GetStats() const { return m_stats; }
+
 /* residual: desired accuracy of solution
    maxIterations: maximum number of iterations to perform 
                   (-1: infinite amount of iterations) */
 
-    void SolveLinearSystem(SparseSymmetricMatrixT<T> &matA, 
-                           vector<T> &x, const vector<T> &b, 
-                           T residual, int maxIterations) 
+    const SolverStats &SolveLinearSystem(SparseSymmetricMatrixT<T> &matA, 
+                                         vector<T> &x, const vector<T> &b, 
+                                         T residual, int maxIterations) 
+    {
+        /* Iterations always run on the compressed-row representation */
+        matA.Finalize();
+
+        const SparseSymmetricMatrixT<T> &A = matA;
+        return SolveLinearSystem(A, x, b, residual, maxIterations);
+    }
+
+    template<class Operator>
+    const SolverStats &SolveLinearSystem(const Operator &A, 
+                                         vector<T> &x, const vector<T> &b, 
+                                         T residual, int maxIterations) 
+    {
+        m_stats.Reset();
+        m_timer.Lap();
+
+        SolverTimer total;
+
+        setupPrecond(A);
+        m_stats.timeSetup = m_timer.Lap();
+
+        if(m_variant == PCG_FUSED)
+            SolveFused(A, x, b, residual, maxIterations);
+        else if(m_variant == PCG_PIPELINED)
+            SolvePipelined(A, x, b, residual, maxIterations);
+        else
+            SolveStandard(A, x, b, residual, maxIterations);
+
+        m_stats.timeTotal = total.Lap();
+        return m_stats;
+    }
+
+    /* Solves A*X = B for numVectors right-hand sides at once. X and B 
+       hold the vectors interleaved, entry j of vector v at 
+       [j*numVectors + v]. Every vector follows its own CG recurrence 
+       (and stops updating once converged), but all share one pass over
+       the matrix per iteration. The stats report the largest residual 
+       of all vectors. */
+    const SolverStats &SolveMultiple(SparseSymmetricMatrixT<T> &matA, 
+                                     vector<T> &X, const vector<T> &B, 
+                                     int numVectors, T residual, int maxIterations) 
+    {
+        matA.Finalize();
+
+        m_stats.Reset();
+        m_timer.Lap();
+
+        SolverTimer total;
+
+        const SparseSymmetricMatrixT<T> &A = matA;
+        setupPrecond(A);
+        m_stats.timeSetup = m_timer.Lap();
+
+        /* Common block widths are compiled separately so that the per 
+           vector loops get unrolled and kept in registers */
+        switch(numVectors)
+        {
+        case 2: solveMultiple<2>(A, X, B, 2, residual, maxIterations); break;
+        case 4: solveMultiple<4>(A, X, B, 4, residual, maxIterations); break;
+        case 8: solveMultiple<8>(A, X, B, 8, residual, maxIterations); break;
+        case 16: solveMultiple<16>(A, X, B, 16, residual, maxIterations); break;
+        default: solveMultiple<0>(A, X, B, numVectors, residual, maxIterations); break;
+        }
+
+        m_stats.timeTotal = total.Lap();
+        return m_stats;
+    }
+
+private:
+    Preconditioner m_precond;
+    bool m_reusePrecond;
+    bool m_precondReady;
+
+    /* Operator the preconditioner was set up for, see setupPrecond() */
+    int m_precondRows;
+    uint64_t m_precondGeneration;
+
+    PCGVariant m_variant;
+
+    PCGCallback m_callback;
+    void *m_callbackData;
+    SolverStats m_stats;
+    SolverTimer m_timer;
+
+    /* Sets up the preconditioner unless it may be reused for A */
+    template<class Operator>
+    void setupPrecond(const Operator &A) 
+    {
+        uint64_t generation = getGeneration(A);
+
+        if(m_reusePrecond && m_precondReady && m_precondRows == A.GetNumRows() && 
+           m_precondGeneration == generation)
+            return;
+
+        m_precond.Setup(A);
+        m_precondReady = true;
+        m_precondRows = A.GetNumRows();
+        m_precondGeneration = generation;
+    }
+
+    /* Other operators do not track modifications */
+    static uint64_t getGeneration(const SparseSymmetricMatrixT<T> &A) { return A.GetGeneration(); }
+    template<class Operator>
+    static uint64_t getGeneration(const Operator &) { return 0; }
+
+    /* Phase bookkeeping: time since the previous call goes to 'time',
+       'sweeps' vector passes of n entries to the vector traffic */
+    void addVectorPhase(double &time, int sweeps, int n) 
+    {
+        time += m_timer.Lap();
+        m_stats.bytesVector += (double)sweeps * n * sizeof(T);
+    }
+
+    template<class Operator>
+    void multVector(const Operator &A, const vector<T> &x, vector<T> &b) 
+    {
+        m_timer.Lap();
+        A.MultVector(x, b);
+        m_stats.timeSpMV += m_timer.Lap();
+        m_stats.bytesSpMV += A.GetProductBytes();
+    }
+
+    void applyPrecond(const vector<T> &r, vector<T> &z) 
+    {
+        m_timer.Lap();
+        m_precond.Apply(r, z);
+        m_stats.timePrecond += m_timer.Lap();
+    }
+
+    /* Iteration of SolveMultiple; NV > 0 fixes the number of vectors at 
+       compile time, NV = 0 takes it from numVectors */
+    template<int NV>
+    void solveMultiple(const SparseSymmetricMatrixT<T> &A, 
+                       vector<T> &X, const vector<T> &B, 
+                       int numVectors, T residual, int maxIterations) 
+    {
+        const int nv = NV > 0 ? NV : numVectors;
+        int n = A.GetNumRows();
+        int size = n * nv;
+
+        vector<T> R(size);
+        vector<T> D(size);
+        vector<T> Q(size);
+        vector<T> S(size);
+
+        vector<T> deltaNew(nv), deltaOld(nv), alpha(nv), beta(nv);
+        vector<char> active(nv);
+
+        multMultiVector(A, X, R, nv);
+
+#pragma omp parallel for schedule(static)
+        for(int i=0; i<size; i++)
+            R[i] = B[i] - R[i];
+        addVectorPhase(m_stats.timeUpdate, 3 * nv, n);
+
+        applyPrecondBlock(m_precond, R, D, nv);
+
+        blockDot<NV>(R, D, deltaNew);
+        addVectorPhase(m_stats.timeReduce, 2 * nv, n);
+        T delta0 = 1.0;
+
+        int iter = 0;
+        while(maxIterations == -1 || iter < maxIterations)
+        {
+            if(recordBlockIteration(iter, deltaNew, active, residual, delta0))
+                break;
+
+            multMultiVector(A, D, Q, nv);
+
+            blockDot<NV>(D, Q, alpha);
+            for(int v=0; v<nv; v++)
+                alpha[v] = active[v] ? deltaNew[v] / alpha[v] : T(0);
+            addVectorPhase(m_stats.timeReduce, 2 * nv, n);
+
+            deltaOld = deltaNew;
+
+            updateBlockResidual<NV>(m_precond, alpha, D, Q, X, R, S, deltaNew);
+
+            /* Local copy: lets the compiler keep the coefficients in 
+               registers instead of reloading them for every entry */
+            T betaFixed[NV > 0 ? NV : 1];
+            for(int v=0; v<nv; v++)
+                beta[v] = active[v] ? deltaNew[v] / deltaOld[v] : T(0);
+            const T *b = NV > 0 ? copyCoefficients<NV>(beta, betaFixed) : beta.data();
+
+#pragma omp parallel for schedule(static)
+            for(int i=0; i<n; i++)
+                for(int v=0; v<nv; v++)
+                    D[i * nv + v] = S[i * nv + v] + b[v] * D[i * nv + v];
+            addVectorPhase(m_stats.timeUpdate, 3 * nv, n);
+
+            iter++;
+        }
+
+        if(iter == maxIterations)
+            recordBlockIteration(iter, deltaNew, active, residual, delta0);
+    }
+
+    template<int NV>
+    static const T *copyCoefficients(const vector<T> &coef, T *fixed) 
+    {
+        for(int v=0; v<NV; v++)
+            fixed[v] = coef[v];
+        return fixed;
+    }
+
+    void multMultiVector(const SparseSymmetricMatrixT<T> &A, const vector<T> &X, 
+                         vector<T> &B, int numVectors) 
+    {
+        m_timer.Lap();
+        A.MultMultiVector(X, B, numVectors);
+        m_stats.timeSpMV += m_timer.Lap();
+        m_stats.bytesSpMV += A.GetProductBytes(numVectors);
+    }
+
+    /* Generic policies are applied vector by vector */
+    template<class P>
+    void applyPrecondBlock(const P &precond, const vector<T> &R, vector<T> &Z, 
+                           int numVectors) 
+    {
+        int n = (int)R.size() / numVectors;
+        vector<T> r(n), z(n);
+
+        m_timer.Lap();
+        for(int v=0; v<numVectors; v++)
+        {
+            for(int i=0; i<n; i++)
+                r[i] = R[i * numVectors + v];
+
+            precond.Apply(r, z);
+
+            for(int i=0; i<n; i++)
+                Z[i * numVectors + v] = z[i];
+        }
+        m_stats.timePrecond += m_timer.Lap();
+    }
+
+    void applyPrecondBlock(const JacobiPreconditionerT<T> &precond, 
+                           const vector<T> &R, vector<T> &Z, int numVectors) 
+    {
+        const vector<T> &invDiag = precond.GetInverseDiagonal();
+        int n = (int)invDiag.size();
+
+        m_timer.Lap();
+#pragma omp parallel for schedule(static)
+        for(int i=0; i<n; i++)
+            for(int v=0; v<numVectors; v++)
+                Z[i * numVectors + v] = invDiag[i] * R[i * numVectors + v];
+        m_stats.timePrecond += m_timer.Lap();
+    }
+
+    /* X += alpha*D, R -= alpha*Q, S = M^-1 R and delta = dot(R, S), all 
+       per vector */
+    template<int NV, class P>
+    void updateBlockResidual(const P &precond, const vector<T> &alpha, 
+                             const vector<T> &D, const vector<T> &Q, 
+                             vector<T> &X, vector<T> &R, vector<T> &S, 
+                             vector<T> &delta) 
+    {
+        const int nv = NV > 0 ? NV : (int)alpha.size();
+        int n = (int)X.size() / nv;
+
+        T alphaFixed[NV > 0 ? NV : 1];
+        const T *a = NV > 0 ? copyCoefficients<NV>(alpha, alphaFixed) : alpha.data();
+
+#pragma omp parallel for schedule(static)
+        for(int i=0; i<n; i++)
+        {
+            for(int v=0; v<nv; v++)
+            {
+                X[i * nv + v] += a[v] * D[i * nv + v];
+                R[i * nv + v] -= a[v] * Q[i * nv + v];
+            }
+        }
+        addVectorPhase(m_stats.timeUpdate, 6 * nv, n);
+
+        applyPrecondBlock(precond, R, S, nv);
+
+        blockDot<NV>(R, S, delta);
+        addVectorPhase(m_stats.timeReduce, 2 * nv, n);
+    }
+
+    template<int NV>
+    void updateBlockResidual(const JacobiPreconditionerT<T> &precond, 
+                             const vector<T> &alpha, 
+                             const vector<T> &D, const vector<T> &Q, 
+                             vector<T> &X, vector<T> &R, vector<T> &S, 
+                             vector<T> &delta) 
+    {
+        const vector<T> &invDiag = precond.GetInverseDiagonal();
+        const int nv = NV > 0 ? NV : (int)alpha.size();
+        int n = (int)invDiag.size();
+
+        T alphaFixed[NV > 0 ? NV : 1];
+        const T *a = NV > 0 ? copyCoefficients<NV>(alpha, alphaFixed) : alpha.data();
+
+        std::fill(delta.begin(), delta.end(), T(0));
+        T *sums = delta.data();
+
+#pragma omp parallel reduction(+:sums[:nv])
+        {
+            T accFixed[NV > 0 ? NV : 1];
+            vector<T> accVar(NV > 0 ? 0 : nv);
+            T *acc = NV > 0 ? accFixed : accVar.data();
+            for(int v=0; v<nv; v++)
+                acc[v] = 0;
+
+#pragma omp for schedule(static)
+            for(int i=0; i<n; i++)
+            {
+                for(int v=0; v<nv; v++)
+                {
+                    int j = i * nv + v;
+
+                    X[j] += a[v] * D[j];
+                    R[j] -= a[v] * Q[j];
+                    S[j] = invDiag[i] * R[j];
+                    acc[v] += R[j] * S[j];
+                }
+            }
+
+            for(int v=0; v<nv; v++)
+                sums[v] += acc[v];
+        }
+        addVectorPhase(m_stats.timeReduce, 7 * nv + 1, n);
+    }
+
+    /* Per vector dot products of two interleaved blocks; every thread 
+       accumulates locally and the partial sums are reduced at the end */
+    template<int NV>
+    static void blockDot(const vector<T> &A, const vector<T> &B, vector<T> &dots) 
+    {
+        const int nv = NV > 0 ? NV : (int)dots.size();
+        int n = (int)A.size() / nv;
+
+        std::fill(dots.begin(), dots.end(), T(0));
+        T *sums = dots.data();
+
+#pragma omp parallel reduction(+:sums[:nv])
+        {
+            T accFixed[NV > 0 ? NV : 1];
+            vector<T> accVar(NV > 0 ? 0 : nv);
+            T *acc = NV > 0 ? accFixed : accVar.data();
+            for(int v=0; v<nv; v++)
+                acc[v] = 0;
+
+#pragma omp for schedule(static)
+            for(int i=0; i<n; i++)
+                for(int v=0; v<nv; v++)
+                    acc[v] += A[i * nv + v] * B[i * nv + v];
+
+            for(int v=0; v<nv; v++)
+                sums[v] += acc[v];
+        }
+    }
+
+    /* Block counterpart of recordIteration: marks the vectors that still
+       iterate, records the largest residual and returns true once all 
+       vectors converged */
+    bool recordBlockIteration(int iter, const vector<T> &delta, vector<char> &active, 
+                              T residual, T delta0) 
     {
-        int n = matA.GetNumRows();
+        T maxDelta = 0;
+        bool converged = true;
+
+        for(int v=0; v<(int)delta.size(); v++)
+        {
+            active[v] = delta[v] > residual*residual*delta0;
+            if(active[v])
+                converged = false;
+            maxDelta = std::max(maxDelta, delta[v]);
+        }
+
+        double res = sqrt((double)maxDelta);
+
+        m_stats.iterations = iter;
+        m_stats.residuals.push_back(res);
+        m_stats.converged = converged;
+
+        if(iter > 0 && m_callback)
+            m_callback(iter, res, m_callbackData);
+
+        return converged;
+    }
+
+    /* delta: squared preconditioned residual norm after 'iter' iterations */
+    bool recordIteration(int iter, T delta, T residual, T delta0) 
+    {
+        double res = sqrt((double)std::max(delta, T(0)));
+
+        m_stats.iterations = iter;
+        m_stats.residuals.push_back(res);
+        m_stats.converged = delta <= residual*residual*delta0;
+
+        if(iter > 0 && m_callback)
+            m_callback(iter, res, m_callbackData);
+
+        return m_stats.converged;
+    }
+
+    template<class Operator>
+    void SolveStandard(const Operator &A, 
+                       vector<T> &x, const vector<T> &b, 
+                       T residual, int maxIterations) 
+    {
+        int n = A.GetNumRows();
         
-        vector<T> precond(n);
         vector<T> r(n);
         vector<T> d(n);
         vector<T> q(n);
         vector<T> s(n);
-        
-        for(int i=0; i<n; i++)
-            precond[i] = 1 / matA(i, i);
 
-        matA.MultVector(x, r);
+        multVector(A, x, r);
         for(int i=0; i<n; i++)
             r[i] = b[i] - r[i];
+        addVectorPhase(m_stats.timeUpdate, 3, n);
 
-        for(int i=0; i<n; i++)
-            d[i] = precond[i] * r[i];
+        applyPrecond(r, d);
        
         T deltaNew = dotProd(r, d);      
+        addVectorPhase(m_stats.timeReduce, 2, n);
         T delta0 = 1.0; 
         
         int iter = 0;
         while(maxIterations == -1 || iter < maxIterations)
         {
-            if(deltaNew <= residual*residual*delta0)
+            if(recordIteration(iter, deltaNew, residual, delta0))
                 break;
 
-            matA.MultVector(d, q);
+            multVector(A, d, q);
            
             T alpha = deltaNew / dotProd(d, q);
+            addVectorPhase(m_stats.timeReduce, 2, n);
 
             for(int i=0; i<n; i++)
                 x[i] += alpha*d[i];
 
             for(int i=0; i<n; i++)
                 r[i] -= alpha*q[i];
+            addVectorPhase(m_stats.timeUpdate, 6, n);
 
-            for(int i=0; i<n; i++)
-                s[i] = precond[i] * r[i];
+            applyPrecond(r, s);
 
             T deltaOld = deltaNew;
 
             deltaNew = dotProd(r, s);
+            addVectorPhase(m_stats.timeReduce, 2, n);
 
             T beta = deltaNew / deltaOld;
 
             for(int i=0; i<n; i++)
                 d[i] = s[i] + beta*d[i];
+            addVectorPhase(m_stats.timeUpdate, 3, n);
 
             iter++;
-            cout << "PCG, iter=" << iter << ", deltaNew=" 
-                 << sqrt(deltaNew) << " vs "<< (residual) <<"\n";
         }   
+
+        if(iter == maxIterations)
+            recordIteration(iter, deltaNew, residual, delta0);
+    }
+
+    /* Per iteration: product, dot(d, q), one sweep updating x and r (and 
+       applying a Jacobi preconditioner while computing dot(r, s)), one 
+       sweep for the new search direction */
+    template<class Operator>
+    void SolveFused(const Operator &A, 
+                    vector<T> &x, const vector<T> &b, 
+                    T residual, int maxIterations) 
+    {
+        int n = A.GetNumRows();
+        
+        vector<T> r(n);
+        vector<T> d(n);
+        vector<T> q(n);
+        vector<T> s(n);
+
+        multVector(A, x, r);
+
+#pragma omp parallel for schedule(static)
+        for(int i=0; i<n; i++)
+            r[i] = b[i] - r[i];
+        addVectorPhase(m_stats.timeUpdate, 3, n);
+
+        applyPrecond(r, d);
+       
+        T deltaNew = parallelDot(r, d);      
+        addVectorPhase(m_stats.timeReduce, 2, n);
+        T delta0 = 1.0; 
+        
+        int iter = 0;
+        while(maxIterations == -1 || iter < maxIterations)
+        {
+            if(recordIteration(iter, deltaNew, residual, delta0))
+                break;
+
+            multVector(A, d, q);
+           
+            T alpha = deltaNew / parallelDot(d, q);
+            addVectorPhase(m_stats.timeReduce, 2, n);
+
+            T deltaOld = deltaNew;
+
+            deltaNew = updateResidual(m_precond, alpha, d, q, x, r, s);
+
+            T beta = deltaNew / deltaOld;
+
+#pragma omp parallel for schedule(static)
+            for(int i=0; i<n; i++)
+                d[i] = s[i] + beta*d[i];
+            addVectorPhase(m_stats.timeUpdate, 3, n);
+
+            iter++;
+        }   
+
+        if(iter == maxIterations)
+            recordIteration(iter, deltaNew, residual, delta0);
+    }
+
+    /* Preconditioned pipelined CG (Ghysels/Vanroose, Alg. 4). Besides the
+       residual r the recurrences carry u = M^-1 r and w = A u, so that the
+       two reductions of an iteration are computed together in the update 
+       sweep and the preconditioner apply m = M^-1 w and product n = A m 
+       do not depend on a reduction finished in the same iteration. The
+       sweep itself is a blocking omp reduction, so in shared memory this
+       saves sweeps over the standard loop but hides no latency. */
+    template<class Operator>
+    void SolvePipelined(const Operator &A, 
+                        vector<T> &x, const vector<T> &b, 
+                        T residual, int maxIterations) 
+    {
+        int n = A.GetNumRows();
+
+        vector<T> r(n), u(n), w(n);
+        vector<T> m(n), nv(n);
+        vector<T> p(n, T(0)), s(n, T(0)), q(n, T(0)), z(n, T(0));
+
+        multVector(A, x, r);
+
+#pragma omp parallel for schedule(static)
+        for(int i=0; i<n; i++)
+            r[i] = b[i] - r[i];
+        addVectorPhase(m_stats.timeUpdate, 3, n);
+
+        applyPrecond(r, u);
+        multVector(A, u, w);
+
+        T gamma = 0;
+        T delta = 0;
+
+#pragma omp parallel for schedule(static) reduction(+:gamma,delta)
+        for(int i=0; i<n; i++)
+        {
+            gamma += r[i] * u[i];
+            delta += w[i] * u[i];
+        }
+        addVectorPhase(m_stats.timeReduce, 3, n);
+
+        T delta0 = 1.0;
+        T gammaOld = 0;
+        T alphaOld = 0;
+
+        int iter = 0;
+        while(maxIterations == -1 || iter < maxIterations)
+        {
+            /* gamma = dot(r, M^-1 r), the quantity the standard loop tests */
+            if(recordIteration(iter, gamma, residual, delta0))
+                break;
+
+            applyPrecond(w, m);
+            multVector(A, m, nv);
+
+            T alpha, beta;
+            if(iter == 0)
+            {
+                beta = 0;
+                alpha = gamma / delta;
+            }
+            else
+            {
+                beta = gamma / gammaOld;
+                alpha = gamma / (delta - beta * gamma / alphaOld);
+            }
+
+            T gammaNew = 0;
+            T deltaNew = 0;
+
+#pragma omp parallel for schedule(static) reduction(+:gammaNew,deltaNew)
+            for(int i=0; i<n; i++)
+            {
+                z[i] = nv[i] + beta * z[i];
+                q[i] = m[i] + beta * q[i];
+                s[i] = w[i] + beta * s[i];
+                p[i] = u[i] + beta * p[i];
+
+                x[i] += alpha * p[i];
+                r[i] -= alpha * s[i];
+                u[i] -= alpha * q[i];
+                w[i] -= alpha * z[i];
+
+                gammaNew += r[i] * u[i];
+                deltaNew += w[i] * u[i];
+            }
+            addVectorPhase(m_stats.timeReduce, 18, n);
+
+            gammaOld = gamma;
+            alphaOld = alpha;
+            gamma = gammaNew;
+            delta = deltaNew;
+
+            iter++;
+        }
+
+        if(iter == maxIterations)
+            recordIteration(iter, gamma, residual, delta0);
+    }
+
+    /* x += alpha*d, r -= alpha*q, s = M^-1 r; returns dot(r, s) */
+    template<class P>
+    T updateResidual(const P &, T alpha, 
+                     const vector<T> &d, const vector<T> &q, 
+                     vector<T> &x, vector<T> &r, vector<T> &s) 
+    {
+        int n = (int)x.size();
+
+#pragma omp parallel for schedule(static)
+        for(int i=0; i<n; i++)
+        {
+            x[i] += alpha*d[i];
+            r[i] -= alpha*q[i];
+        }
+        addVectorPhase(m_stats.timeUpdate, 6, n);
+
+        applyPrecond(r, s);
+
+        T v = parallelDot(r, s);
+        addVectorPhase(m_stats.timeReduce, 2, n);
+
+        return v;
+    }
+
+    T updateResidual(const JacobiPreconditionerT<T> &precond, T alpha, 
+                     const vector<T> &d, const vector<T> &q, 
+                     vector<T> &x, vector<T> &r, vector<T> &s) 
+    {
+        const vector<T> &invDiag = precond.GetInverseDiagonal();
+        int n = (int)x.size();
+        double v = 0;
+
+#pragma omp parallel for schedule(static) reduction(+:v)
+        for(int i=0; i<n; i++)
+        {
+            x[i] += alpha*d[i];
+            r[i] -= alpha*q[i];
+            s[i] = invDiag[i] * r[i];
+            v += r[i] * s[i];
+        }
+        addVectorPhase(m_stats.timeReduce, 8, n);
+
+        return (T)v;
+    }
+
+    /* Dot products accumulate in double: with T = float long sums would
+       otherwise lose enough digits to slow down convergence */
+    static T parallelDot(const vector<T> &a, const vector<T> &b) 
+    {
+        int n = (int)a.size();
+        double v = 0;
+
+#pragma omp parallel for schedule(static) reduction(+:v)
+        for(int i=0; i<n; i++)
+            v += a[i] * b[i];
+
+        return (T)v;
     }
 
-private:
     static T dotProd(const vector<T> &a, const vector<T> &b) 
     {
-        T v = 0;
+        double v = 0;
         
         for(int i=0; i<(int)a.size(); i++)
             v += a[i] * b[i];
         
-        return v;
+        return (T)v;
     }
 };
 
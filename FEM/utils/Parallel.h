@@ -0,0 +1,45 @@
+/******************************************************************
+*
+* Parallel.h
+*
+* Description: 
+*
+* Thin wrapper around OpenMP to query and set the number of worker
+* threads used by the parallel kernels. Without OpenMP everything 
+* runs single-threaded and the pragmas are ignored.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+inline int GetNumThreads() 
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+inline void SetNumThreads(int numThreads) 
+{
+#ifdef _OPENMP
+    if(numThreads > 0)
+        omp_set_num_threads(numThreads);
+#else
+    (void)numThreads;
+#endif
+}
+
+#endif
@@ -0,0 +1,154 @@
+/******************************************************************
+*
+* Preconditioners.h
+*
+* Description: Preconditioner policies for SparseLinSolverPCGT.
+*
+* A policy provides 
+*   Setup(A)    - (re)computes the preconditioner for matrix A
+*   Apply(r, z) - computes z = M^-1 * r
+*
+* JacobiPreconditionerT:            M = diag(A), works with any operator
+*   providing GetDiagonal()
+* IncompleteCholeskyPreconditionerT: M = L*L^T, zero-fill incomplete 
+*   Cholesky factor IC(0) with the sparsity pattern of the lower 
+*   triangle of A; applied via forward/backward substitution.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __PRECONDITIONERS_T_H__
+#define __PRECONDITIONERS_T_H__
+
+#include <cmath>
+#include <vector>
+
+#include "SparseSymMat.h"
+
+using std::vector;
+
+/*----------------------------------------------------------------*/
+template<class T>
+class JacobiPreconditionerT
+{
+public:
+    template<class Operator>
+    void Setup(const Operator &matA) 
+    {
+        int n = matA.GetNumRows();
+
+        matA.GetDiagonal(m_invDiag);
+        for(int i=0; i<n; i++)
+            m_invDiag[i] = 1 / m_invDiag[i];
+    }
+
+    void Apply(const vector<T> &r, vector<T> &z) const 
+    {
+        for(int i=0; i<(int)r.size(); i++)
+            z[i] = m_invDiag[i] * r[i];
+    }
+
+    /* Lets solvers fuse the scaling into their own vector loops */
+    const vector<T> &GetInverseDiagonal() const { return m_invDiag; }
+
+private:
+    vector<T> m_invDiag;
+};
+
+/*----------------------------------------------------------------*/
+template<class T>
+class IncompleteCholeskyPreconditionerT
+{
+public:
+    /* Matrix must be finalized; every row needs its diagonal entry */
+    void Setup(const SparseSymmetricMatrixT<T> &matA) 
+    {
+        int n = matA.GetNumRows();
+
+        m_rowPtr = matA.GetRowPtr();
+        m_colIdx = matA.GetColIdx();
+        m_L = matA.GetValues();
+
+        /* Columns are ascending and never exceed the row: the diagonal
+           is the last entry of every row */
+        for(int i=0; i<n; i++)
+        {
+            int diag = m_rowPtr[i + 1] - 1;
+
+            for(int k=m_rowPtr[i]; k<diag; k++)
+            {
+                int j = m_colIdx[k];
+
+                /* L_ij = (a_ij - sum_{m<j} L_im * L_jm) / L_jj, summing over 
+                   the common pattern of rows i and j */
+                T sum = m_L[k];
+                int p = m_rowPtr[i];
+                int q = m_rowPtr[j];
+                int jDiag = m_rowPtr[j + 1] - 1;
+
+                while(p < k && q < jDiag)
+                {
+                    if(m_colIdx[p] == m_colIdx[q])
+                        sum -= m_L[p++] * m_L[q++];
+                    else if(m_colIdx[p] < m_colIdx[q])
+                        p++;
+                    else
+                        q++;
+                }
+
+                m_L[k] = sum / m_L[jDiag];
+            }
+
+            T d = m_L[diag];
+            for(int k=m_rowPtr[i]; k<diag; k++)
+                d -= m_L[k] * m_L[k];
+
+            /* Breakdown (not expected for M-matrices): keep the original 
+               diagonal entry */
+            if(d <= 0)
+                d = fabs(matA.GetValues()[diag]);
+
+            m_L[diag] = sqrt(d);
+        }
+    }
+
+    void Apply(const vector<T> &r, vector<T> &z) const 
+    {
+        int n = (int)r.size();
+
+        /* Forward substitution L*y = r (y stored in z) */
+        for(int i=0; i<n; i++)
+        {
+            int diag = m_rowPtr[i + 1] - 1;
+            T sum = r[i];
+
+            for(int k=m_rowPtr[i]; k<diag; k++)
+                sum -= m_L[k] * z[m_colIdx[k]];
+
+            z[i] = sum / m_L[diag];
+        }
+
+        /* Backward substitution L^T*z = y, column-wise over the rows of L */
+        for(int i=n-1; i>=0; i--)
+        {
+            int diag = m_rowPtr[i + 1] - 1;
+            z[i] /= m_L[diag];
+
+            T zi = z[i];
+            for(int k=m_rowPtr[i]; k<diag; k++)
+                z[m_colIdx[k]] -= m_L[k] * zi;
+        }
+    }
+
+private:
+    vector<int> m_rowPtr;
+    vector<int> m_colIdx;
+    vector<T> m_L;
+};
+
+#endif
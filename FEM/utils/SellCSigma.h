@@ -0,0 +1,298 @@
+/******************************************************************
+*
+* SellCSigma.h
+*
+* Description: 
+*
+* Sliced ELLPACK (SELL-C-sigma) copy of a symmetric CSR matrix, used as
+* alternative SpMV backend of SparseSymmetricMatrixT. Rows are sorted 
+* by length inside windows of sigma rows, then grouped into chunks of 
+* C = 8 rows. Each chunk is padded to its longest row and stored column
+* by column, so one SIMD register processes 8 rows at once.
+*
+* Both triangles are stored explicitly (gathered via the transpose 
+* index of the CSR matrix). For every slot the position of its value in
+* the CSR value array is kept, so values can be refreshed after in-place
+* modifications without rebuilding the layout.
+*
+* The product kernel is selected at runtime via CPUID: AVX-512, AVX2 or
+* a portable scalar loop.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __SELLCSIGMA_T_H__
+#define __SELLCSIGMA_T_H__
+
+#include <algorithm>
+#include <vector>
+
+#include "Parallel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SELL_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+using std::vector;
+
+/*----------------------------------------------------------------*/
+/* Product kernels for the chunk range [chunkBegin, chunkEnd) */
+template<class T>
+struct SellKernelsT
+{
+    typedef void (*Kernel)(int chunkBegin, int chunkEnd, const int *chunkPtr, 
+                           const int *chunkLen, const int *cols, const T *vals,
+                           const int *perm, int nrows, const T *x, T *y);
+
+    static void Scalar(int chunkBegin, int chunkEnd, const int *chunkPtr, 
+                       const int *chunkLen, const int *cols, const T *vals,
+                       const int *perm, int nrows, const T *x, T *y)
+    {
+        for(int c=chunkBegin; c<chunkEnd; c++)
+        {
+            T sum[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+            for(int j=0; j<chunkLen[c]; j++)
+            {
+                int base = chunkPtr[c] + 8 * j;
+                for(int r=0; r<8; r++)
+                    sum[r] += vals[base + r] * x[cols[base + r]];
+            }
+
+            for(int r=0; r<8; r++)
+                if(c * 8 + r < nrows)
+                    y[perm[c * 8 + r]] = sum[r];
+        }
+    }
+
+    static Kernel Select() { return Scalar; }
+};
+
+#ifdef SELL_X86_KERNELS
+
+__attribute__((target("avx2,fma")))
+inline void SellKernelAVX2(int chunkBegin, int chunkEnd, const int *chunkPtr, 
+                           const int *chunkLen, const int *cols, const double *vals,
+                           const int *perm, int nrows, const double *x, double *y)
+{
+    for(int c=chunkBegin; c<chunkEnd; c++)
+    {
+        __m256d sumLo = _mm256_setzero_pd();
+        __m256d sumHi = _mm256_setzero_pd();
+        __m256d allLanes = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+
+        for(int j=0; j<chunkLen[c]; j++)
+        {
+            int base = chunkPtr[c] + 8 * j;
+
+            __m128i colLo = _mm_loadu_si128((const __m128i *)(cols + base));
+            __m128i colHi = _mm_loadu_si128((const __m128i *)(cols + base + 4));
+
+            __m256d xLo = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), x, colLo, allLanes, 8);
+            __m256d xHi = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), x, colHi, allLanes, 8);
+
+            sumLo = _mm256_fmadd_pd(_mm256_loadu_pd(vals + base), xLo, sumLo);
+            sumHi = _mm256_fmadd_pd(_mm256_loadu_pd(vals + base + 4), xHi, sumHi);
+        }
+
+        double sum[8];
+        _mm256_storeu_pd(sum, sumLo);
+        _mm256_storeu_pd(sum + 4, sumHi);
+
+        for(int r=0; r<8; r++)
+            if(c * 8 + r < nrows)
+                y[perm[c * 8 + r]] = sum[r];
+    }
+}
+
+__attribute__((target("avx512f")))
+inline void SellKernelAVX512(int chunkBegin, int chunkEnd, const int *chunkPtr, 
+                             const int *chunkLen, const int *cols, const double *vals,
+                             const int *perm, int nrows, const double *x, double *y)
+{
+    for(int c=chunkBegin; c<chunkEnd; c++)
+    {
+        __m512d sum = _mm512_setzero_pd();
+
+        for(int j=0; j<chunkLen[c]; j++)
+        {
+            int base = chunkPtr[c] + 8 * j;
+
+            __m256i col = _mm256_loadu_si256((const __m256i *)(cols + base));
+            __m512d xv = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xFF, col, x, 8);
+
+            sum = _mm512_fmadd_pd(_mm512_loadu_pd(vals + base), xv, sum);
+        }
+
+        double out[8];
+        _mm512_storeu_pd(out, sum);
+
+        for(int r=0; r<8; r++)
+            if(c * 8 + r < nrows)
+                y[perm[c * 8 + r]] = out[r];
+    }
+}
+
+template<>
+inline SellKernelsT<double>::Kernel SellKernelsT<double>::Select()
+{
+    __builtin_cpu_init();
+
+    if(__builtin_cpu_supports("avx512f"))
+        return SellKernelAVX512;
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return SellKernelAVX2;
+
+    return Scalar;
+}
+
+#endif
+
+/*----------------------------------------------------------------*/
+template<class T>
+class SellCSigmaMatrixT
+{
+public:
+    enum { C = 8 };
+
+    SellCSigmaMatrixT() 
+    {
+        m_numRows = 0;
+        m_kernel = SellKernelsT<T>::Select();
+    }
+
+    /* Builds the layout from a finalized lower-triangular CSR matrix and
+       its transpose index (see SparseSymmetricMatrixT) */
+    void Build(int nrows, const int *rowPtr, const int *colIdx, 
+               const int *upperPtr, const int *upperCol, const int *upperSrc,
+               const T *values, int sigma = 256) 
+    {
+        m_numRows = nrows;
+        int numChunks = (nrows + C - 1) / C;
+
+        /* Sort rows by full length, descending, inside each sigma window */
+        m_perm.resize(numChunks * C);
+        for(int i=0; i<nrows; i++)
+            m_perm[i] = i;
+
+        vector<int> length(nrows);
+        for(int i=0; i<nrows; i++)
+            length[i] = (rowPtr[i + 1] - rowPtr[i]) + (upperPtr[i + 1] - upperPtr[i]);
+
+        for(int start=0; start<nrows; start+=sigma)
+        {
+            int end = std::min(start + sigma, nrows);
+            std::stable_sort(m_perm.begin() + start, m_perm.begin() + end, 
+                             LongerRow(length));
+        }
+
+        /* Padding rows of the last chunk point to row 0 with value 0 */
+        for(int i=nrows; i<numChunks * C; i++)
+            m_perm[i] = nrows > 0 ? m_perm[0] : 0;
+
+        m_chunkLen.resize(numChunks);
+        m_chunkPtr.resize(numChunks + 1);
+        m_chunkPtr[0] = 0;
+        for(int c=0; c<numChunks; c++)
+        {
+            int width = 0;
+            for(int r=0; r<C && c * C + r < nrows; r++)
+                width = std::max(width, length[m_perm[c * C + r]]);
+
+            m_chunkLen[c] = width;
+            m_chunkPtr[c + 1] = m_chunkPtr[c] + width * C;
+        }
+
+        int numSlots = m_chunkPtr[numChunks];
+        m_cols.assign(numSlots, 0);
+        m_src.assign(numSlots, -1);
+        m_vals.assign(numSlots, 0);
+
+        for(int c=0; c<numChunks; c++)
+        {
+            for(int r=0; r<C; r++)
+            {
+                int slot = m_chunkPtr[c] + r;
+                int row = m_perm[c * C + r];
+
+                if(c * C + r >= nrows)
+                    continue;
+
+                for(int k=rowPtr[row]; k<rowPtr[row + 1]; k++, slot+=C)
+                {
+                    m_cols[slot] = colIdx[k];
+                    m_src[slot] = k;
+                }
+
+                for(int k=upperPtr[row]; k<upperPtr[row + 1]; k++, slot+=C)
+                {
+                    m_cols[slot] = upperCol[k];
+                    m_src[slot] = upperSrc[k];
+                }
+
+                /* Remaining slots: column of the row itself, value 0 */
+                for(; slot<m_chunkPtr[c + 1]; slot+=C)
+                    m_cols[slot] = row;
+            }
+        }
+
+        Refresh(values);
+    }
+
+    /* Reloads all values from the CSR value array the layout was built for */
+    void Refresh(const T *values) 
+    {
+        int numSlots = (int)m_src.size();
+
+        for(int s=0; s<numSlots; s++)
+            m_vals[s] = m_src[s] >= 0 ? values[m_src[s]] : 0;
+    }
+
+    void MultVector(const vector<T> &x, vector<T> &b) const 
+    {
+        int numChunks = (int)m_chunkLen.size();
+
+#pragma omp parallel
+        {
+            int chunkBegin = 0, chunkEnd = numChunks;
+#ifdef _OPENMP
+            int numThreads = omp_get_num_threads();
+            int thread = omp_get_thread_num();
+            chunkBegin = (int)((long long)numChunks * thread / numThreads);
+            chunkEnd = (int)((long long)numChunks * (thread + 1) / numThreads);
+#endif
+            m_kernel(chunkBegin, chunkEnd, m_chunkPtr.data(), m_chunkLen.data(),
+                     m_cols.data(), m_vals.data(), m_perm.data(), m_numRows,
+                     x.data(), b.data());
+        }
+    }
+
+    int GetNumSlots() const { return (int)m_vals.size(); }
+
+private:
+    struct LongerRow
+    {
+        LongerRow(const vector<int> &length) : m_length(length) {}
+        bool operator()(int a, int b) const { return m_length[a] > m_length[b]; }
+        const vector<int> &m_length;
+    };
+
+    int m_numRows;
+
+    vector<int> m_perm; /* Chunk row -> matrix row */
+    vector<int> m_chunkLen; /* Padded width of every chunk */
+    vector<int> m_chunkPtr; /* First slot of every chunk */
+    vector<int> m_cols;
+    vector<int> m_src; /* Slot -> CSR value index, -1 for padding */
+    vector<T> m_vals;
+
+    typename SellKernelsT<T>::Kernel m_kernel;
+};
+
+#endif
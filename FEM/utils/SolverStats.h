@@ -0,0 +1,90 @@
+/******************************************************************
+*
+* SolverStats.h
+*
+* Description: 
+*
+* Convergence and performance record of an iterative solve, filled in
+* by SparseLinSolverPCGT. Times are wall-clock seconds per phase; the
+* byte counts are estimates of the compulsory memory traffic (every 
+* array touched once per pass), so GetBandwidth() is a lower bound of
+* the bandwidth actually achieved.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __SOLVERSTATS_H__
+#define __SOLVERSTATS_H__
+
+#include <chrono>
+#include <vector>
+
+using std::vector;
+
+struct SolverStats
+{
+    int iterations;
+    int refinements; /* Outer steps of mixed-precision refinement */
+    bool converged;
+
+    /* Preconditioned residual norm sqrt(r^T M^-1 r): initial value 
+       followed by one entry per iteration (per refinement step for 
+       mixed-precision solves) */
+    vector<double> residuals;
+
+    double timeSetup;   /* Preconditioner setup */
+    double timeSpMV;    /* Operator products */
+    double timePrecond; /* Preconditioner applications */
+    double timeReduce;  /* Sweeps computing dot products (including 
+                           vector updates fused into them) */
+    double timeUpdate;  /* Remaining vector updates */
+    double timeTotal;
+
+    double bytesSpMV;   /* Estimated traffic of the operator products */
+    double bytesVector; /* Estimated traffic of reductions and updates */
+
+    SolverStats() { Reset(); }
+
+    void Reset() 
+    {
+        iterations = 0;
+        refinements = 0;
+        converged = false;
+        residuals.clear();
+        timeSetup = timeSpMV = timePrecond = timeReduce = timeUpdate = timeTotal = 0;
+        bytesSpMV = bytesVector = 0;
+    }
+
+    /* GB/s over products, reductions and updates (preconditioner 
+       traffic is not known in general and excluded) */
+    double GetBandwidth() const 
+    {
+        double time = timeSpMV + timeReduce + timeUpdate;
+        return time > 0 ? (bytesSpMV + bytesVector) / time * 1e-9 : 0;
+    }
+};
+
+/* Wall-clock stopwatch; Lap() returns the seconds since the last lap */
+class SolverTimer
+{
+public:
+    SolverTimer() { m_last = std::chrono::steady_clock::now(); }
+
+    double Lap() 
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed = now - m_last;
+        m_last = now;
+        return elapsed.count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_last;
+};
+
+#endif
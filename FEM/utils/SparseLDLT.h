@@ -0,0 +1,344 @@
+/******************************************************************
+*
+* SparseLDLT.h
+*
+* Description: 
+*
+* Sparse direct solver A = P^T*L*D*L^T*P for symmetric matrices stored 
+* as SparseSymmetricMatrixT (finalized). Three phases:
+*
+*  Analyze()   - fill-reducing minimum degree ordering P, elimination 
+*                tree and column counts of L (depends on pattern only)
+*  Factorize() - numeric up-looking LDL^T factorization, row by row 
+*                along the elimination tree (T. Davis, "Algorithm 849: 
+*                A concise sparse Cholesky factorization package")
+*  Solve()     - permuted forward/diagonal/backward substitution
+*
+* A factorization can be reused for any number of right-hand sides.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __SPARSELDLT_T_H__
+#define __SPARSELDLT_T_H__
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "SparseSymMat.h"
+
+using std::vector;
+
+template<class T>
+class SparseLDLT
+{
+public:
+    SparseLDLT() 
+    {
+        m_n = 0;
+        m_analyzed = false;
+        m_factorized = false;
+        m_generation = 0;
+    }
+
+    bool IsAnalyzed() const { return m_analyzed; }
+    bool IsFactorized() const { return m_factorized; }
+
+    /* Factorization of matA as it is now, i.e. of a matrix with the same
+       generation (see SparseSymmetricMatrixT::GetGeneration) */
+    bool IsFactorized(const SparseSymmetricMatrixT<T> &matA) const 
+    {
+        return m_factorized && m_n == matA.GetNumRows() && 
+               m_generation == matA.GetGeneration();
+    }
+
+    /* Number of off-diagonal entries of L */
+    int GetFactorNonZeros() const { return m_n > 0 ? m_Lp[m_n] : 0; }
+
+    /* Symbolic phase; matA must be finalized */
+    void Analyze(const SparseSymmetricMatrixT<T> &matA) 
+    {
+        m_n = matA.GetNumRows();
+
+        MinimumDegreeOrdering(matA);
+        PermuteStructure(matA);
+
+        /* Elimination tree and column counts of L */
+        m_parent.assign(m_n, -1);
+        vector<int> flag(m_n);
+        vector<int> lnz(m_n, 0);
+
+        for(int k=0; k<m_n; k++)
+        {
+            flag[k] = k;
+            for(int p=m_Cp[k]; p<m_Cp[k + 1]; p++)
+            {
+                for(int i=m_Ci[p]; flag[i] != k; i=m_parent[i])
+                {
+                    if(m_parent[i] == -1)
+                        m_parent[i] = k;
+                    lnz[i]++;
+                    flag[i] = k;
+                }
+            }
+        }
+
+        m_Lp.resize(m_n + 1);
+        m_Lp[0] = 0;
+        for(int k=0; k<m_n; k++)
+            m_Lp[k + 1] = m_Lp[k] + lnz[k];
+
+        m_Li.resize(m_Lp[m_n]);
+        m_Lx.resize(m_Lp[m_n]);
+        m_D.resize(m_n);
+
+        m_analyzed = true;
+        m_factorized = false;
+    }
+
+    /* Numeric phase; matA must have the pattern given to Analyze(). 
+       Returns false if a zero pivot is encountered. */
+    bool Factorize(const SparseSymmetricMatrixT<T> &matA) 
+    {
+        if(!m_analyzed)
+            Analyze(matA);
+
+        const vector<T> &values = matA.GetValues();
+
+        vector<T> y(m_n, T(0));
+        vector<int> pattern(m_n);
+        vector<int> flag(m_n);
+        vector<int> lnz(m_n, 0);
+
+        m_factorized = false;
+
+        for(int k=0; k<m_n; k++)
+        {
+            /* Nonzero pattern of row k of L: reach of the entries of 
+               column k of the (permuted) upper triangle in the etree */
+            int top = m_n;
+            flag[k] = k;
+            y[k] = 0;
+
+            for(int p=m_Cp[k]; p<m_Cp[k + 1]; p++)
+            {
+                int i = m_Ci[p];
+                y[i] += values[m_Csrc[p]];
+
+                int len = 0;
+                for(; flag[i] != k; i=m_parent[i])
+                {
+                    pattern[len++] = i;
+                    flag[i] = k;
+                }
+                while(len > 0)
+                    pattern[--top] = pattern[--len];
+            }
+
+            m_D[k] = y[k];
+            if(m_diagSrc[k] >= 0)
+                m_D[k] += values[m_diagSrc[k]];
+            y[k] = 0;
+
+            for(; top<m_n; top++)
+            {
+                int i = pattern[top];
+                T yi = y[i];
+                y[i] = 0;
+
+                int p2 = m_Lp[i] + lnz[i];
+                for(int p=m_Lp[i]; p<p2; p++)
+                    y[m_Li[p]] -= m_Lx[p] * yi;
+
+                T lki = yi / m_D[i];
+                m_D[k] -= lki * yi;
+                m_Li[p2] = k;
+                m_Lx[p2] = lki;
+                lnz[i]++;
+            }
+
+            if(m_D[k] == 0)
+                return false;
+        }
+
+        m_factorized = true;
+        m_generation = matA.GetGeneration();
+        return true;
+    }
+
+    /* Solves A*x = b with the current factorization */
+    void Solve(const vector<T> &b, vector<T> &x) const 
+    {
+        vector<T> z(m_n);
+        for(int k=0; k<m_n; k++)
+            z[k] = b[m_perm[k]];
+
+        for(int j=0; j<m_n; j++)
+            for(int p=m_Lp[j]; p<m_Lp[j + 1]; p++)
+                z[m_Li[p]] -= m_Lx[p] * z[j];
+
+        for(int j=0; j<m_n; j++)
+            z[j] /= m_D[j];
+
+        for(int j=m_n-1; j>=0; j--)
+            for(int p=m_Lp[j]; p<m_Lp[j + 1]; p++)
+                z[j] -= m_Lx[p] * z[m_Li[p]];
+
+        for(int k=0; k<m_n; k++)
+            x[m_perm[k]] = z[k];
+    }
+
+private:
+    /* Greedy minimum degree on the explicit elimination graph: repeatedly
+       eliminates a node of smallest degree and turns its neighborhood 
+       into a clique. Ties are broken by the lower node index. */
+    void MinimumDegreeOrdering(const SparseSymmetricMatrixT<T> &matA) 
+    {
+        const vector<int> &rowPtr = matA.GetRowPtr();
+        const vector<int> &colIdx = matA.GetColIdx();
+
+        vector<vector<int> > adj(m_n);
+        for(int i=0; i<m_n; i++)
+        {
+            for(int k=rowPtr[i]; k<rowPtr[i + 1]; k++)
+            {
+                int j = colIdx[k];
+                if(j != i)
+                {
+                    adj[i].push_back(j);
+                    adj[j].push_back(i);
+                }
+            }
+        }
+        for(int i=0; i<m_n; i++)
+        {
+            std::sort(adj[i].begin(), adj[i].end());
+            adj[i].erase(std::unique(adj[i].begin(), adj[i].end()), adj[i].end());
+        }
+
+        typedef std::pair<int, int> Entry; /* (degree, node) */
+        std::priority_queue<Entry, vector<Entry>, std::greater<Entry> > queue;
+        for(int i=0; i<m_n; i++)
+            queue.push(Entry((int)adj[i].size(), i));
+
+        vector<char> eliminated(m_n, 0);
+        vector<int> merged;
+        m_perm.clear();
+        m_perm.reserve(m_n);
+
+        while(!queue.empty())
+        {
+            Entry top = queue.top();
+            queue.pop();
+
+            int v = top.second;
+            if(eliminated[v] || top.first != (int)adj[v].size())
+                continue;   /* stale entry */
+
+            eliminated[v] = 1;
+            m_perm.push_back(v);
+
+            const vector<int> &nbrs = adj[v];
+            for(int a=0; a<(int)nbrs.size(); a++)
+            {
+                int u = nbrs[a];
+
+                merged.clear();
+                std::set_union(adj[u].begin(), adj[u].end(), nbrs.begin(), nbrs.end(),
+                               std::back_inserter(merged));
+
+                adj[u].clear();
+                for(int b=0; b<(int)merged.size(); b++)
+                    if(merged[b] != u && merged[b] != v)
+                        adj[u].push_back(merged[b]);
+
+                queue.push(Entry((int)adj[u].size(), u));
+            }
+
+            vector<int>().swap(adj[v]);
+        }
+
+        m_pinv.resize(m_n);
+        for(int k=0; k<m_n; k++)
+            m_pinv[m_perm[k]] = k;
+    }
+
+    /* Strict upper triangle of P*A*P^T in compressed columns; every entry 
+       remembers its position in the CSR value array of A */
+    void PermuteStructure(const SparseSymmetricMatrixT<T> &matA) 
+    {
+        const vector<int> &rowPtr = matA.GetRowPtr();
+        const vector<int> &colIdx = matA.GetColIdx();
+
+        m_Cp.assign(m_n + 1, 0);
+        m_diagSrc.assign(m_n, -1);
+
+        for(int i=0; i<m_n; i++)
+        {
+            for(int k=rowPtr[i]; k<rowPtr[i + 1]; k++)
+            {
+                int pi = m_pinv[i];
+                int pj = m_pinv[colIdx[k]];
+                if(pi != pj)
+                    m_Cp[std::max(pi, pj) + 1]++;
+            }
+        }
+        for(int k=0; k<m_n; k++)
+            m_Cp[k + 1] += m_Cp[k];
+
+        m_Ci.resize(m_Cp[m_n]);
+        m_Csrc.resize(m_Cp[m_n]);
+
+        vector<int> fill(m_Cp.begin(), m_Cp.end() - 1);
+        for(int i=0; i<m_n; i++)
+        {
+            for(int k=rowPtr[i]; k<rowPtr[i + 1]; k++)
+            {
+                int pi = m_pinv[i];
+                int pj = m_pinv[colIdx[k]];
+
+                if(pi == pj)
+                {
+                    m_diagSrc[pi] = k;
+                    continue;
+                }
+
+                int pos = fill[std::max(pi, pj)]++;
+                m_Ci[pos] = std::min(pi, pj);
+                m_Csrc[pos] = k;
+            }
+        }
+    }
+
+    int m_n;
+    bool m_analyzed;
+    bool m_factorized;
+    uint64_t m_generation; /* Of the factorized matrix */
+
+    vector<int> m_perm; /* New index -> original index */
+    vector<int> m_pinv; /* Original index -> new index */
+
+    /* Permuted matrix structure (strict upper triangle, by columns) */
+    vector<int> m_Cp;
+    vector<int> m_Ci;
+    vector<int> m_Csrc;
+    vector<int> m_diagSrc;
+
+    /* Factor: elimination tree, L by columns (unit diagonal), D */
+    vector<int> m_parent;
+    vector<int> m_Lp;
+    vector<int> m_Li;
+    vector<T> m_Lx;
+    vector<T> m_D;
+};
+
+#endif
@@ -7,6 +7,19 @@
 * Symmetric sparse matrix, using dynamic data structures to allow fill-ins. 
 * Note: Only lower-triagonal elements of matrix stored and accessible.
 *
+* After assembly the matrix can be frozen into compressed-row (CSR)
+* storage via Finalize(). The sparsity pattern is immutable from then
+* on; existing entries may still be modified in place.
+*
+* For multithreaded products a transpose index is kept with the CSR
+* arrays: for every row it lists the entries of the upper triangle 
+* (stored as lower entries of later rows). Each row of A*x can then be
+* gathered independently, without write conflicts.
+*
+* Optionally the product uses a SELL-C-sigma copy of the matrix (see 
+* SellCSigma.h). The copy is refreshed lazily whenever the values may
+* have been modified through a non-const accessor.
+*
 * Physically-Based Simulation Proseminar WS 2015
 *
 * Interactive Graphics and Simulation Group
@@ -18,8 +31,27 @@
 #ifndef __SPARSESYMMAT_T_H__
 #define __SPARSESYMMAT_T_H__
 
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <map>
+#include <utility>
+#include <vector>
+
+#include "Parallel.h"
+#include "SellCSigma.h"
+
 using std::map;
+using std::vector;
+
+/* Kernels available for SparseSymmetricMatrixT::MultVector */
+enum SpMVBackend 
+{
+    SPMV_CSR,   /* Compressed rows, lower triangle only */
+    SPMV_SELL   /* SELL-C-sigma, SIMD kernels where supported */
+};
 
 template<class T>
 class SparseSymmetricMatrixT
@@ -28,18 +60,35 @@ public:
     SparseSymmetricMatrixT(int numRowsCols) 
     {
         m_numCols = numRowsCols;
+        m_finalized = false;
+        m_backend = SPMV_CSR;
+        m_sellLayoutValid = false;
+        modified();
         m_rowData.resize(numRowsCols);
     }
 
     SparseSymmetricMatrixT() 
     {
         m_numCols = 0;
+        m_finalized = false;
+        m_backend = SPMV_CSR;
+        m_sellLayoutValid = false;
+        modified();
     }
 
     void Clear() 
     {
         m_numCols = 0;
+        m_finalized = false;
         m_rowData.clear();
+        m_rowPtr.clear();
+        m_colIdx.clear();
+        m_values.clear();
+        m_upperPtr.clear();
+        m_upperCol.clear();
+        m_upperSrc.clear();
+        m_sellLayoutValid = false;
+        modified();
     }
 
     virtual ~SparseSymmetricMatrixT() {}
@@ -51,8 +100,190 @@ public:
         m_rowData.resize(numRowsCols);
     }
 
+    /* Freezes the matrix into CSR storage (row pointer, column index and
+       value arrays, columns ascending within each row). The map-based
+       rows are released; no new entries can be created afterwards. */
+    void Finalize() 
+    {
+        if(m_finalized)
+            return;
+
+        int nrows = (int)m_rowData.size();
+
+        m_rowPtr.resize(nrows + 1);
+        m_rowPtr[0] = 0;
+        for(int row=0; row<nrows; row++)
+            m_rowPtr[row + 1] = m_rowPtr[row] + (int)m_rowData[row].size();
+
+        m_colIdx.resize(m_rowPtr[nrows]);
+        m_values.resize(m_rowPtr[nrows]);
+
+        for(int row=0; row<nrows; row++)
+        {
+            int k = m_rowPtr[row];
+            const map<int, T> &rowData = m_rowData[row];
+
+            for(typename map<int, T>::const_iterator iter = rowData.begin(); iter != rowData.end(); iter++, k++)
+            {
+                m_colIdx[k] = iter->first;
+                m_values[k] = iter->second;
+            }
+        }
+
+        m_rowData.clear();
+        m_rowData.shrink_to_fit();
+        m_finalized = true;
+
+        BuildTransposeIndex();
+    }
+
+    bool IsFinalized() const { return m_finalized; }
+
+    /* Stamp of the current contents, unique among all matrices: renewed
+       whenever entries may have been modified (non-const accessors, 
+       Clear, SetCSR, FixMatrix, ...), kept by Finalize() and copied with
+       the matrix. Lets cached factorizations and preconditioners detect
+       that they were built for another matrix. */
+    uint64_t GetGeneration() const { return m_generation; }
+
+    /* Position of entry (row, col) in the CSR value array, or -1 if the
+       entry is not part of the sparsity pattern. Requires Finalize(). */
+    int FindOffset(int row, int col) const 
+    {
+        const int *first = m_colIdx.data() + m_rowPtr[row];
+        const int *last = m_colIdx.data() + m_rowPtr[row + 1];
+        const int *pos = std::lower_bound(first, last, col);
+
+        if(pos == last || *pos != col)
+            return -1;
+
+        return (int)(pos - m_colIdx.data());
+    }
+
+    /* Replaces the contents by an already finalized CSR matrix; the
+       arrays are taken over by swapping. Columns must be ascending and 
+       not exceed the row index. */
+    void SetCSR(int numRowsCols, vector<int> &rowPtr, vector<int> &colIdx, vector<T> &values) 
+    {
+        Clear();
+        m_numCols = numRowsCols;
+        m_rowPtr.swap(rowPtr);
+        m_colIdx.swap(colIdx);
+        m_values.swap(values);
+        m_finalized = true;
+
+        BuildTransposeIndex();
+    }
+
+    /* Adds the finalized matrix other, which may have more rows, to this
+       finalized matrix; the pattern becomes the union of both patterns.
+       Entries listed in removed (row >= col, sorted by row and column)
+       are dropped from the result, e.g. couplings that vanished. */
+    void AddMatrix(const SparseSymmetricMatrixT<T> &other, 
+                   const vector<std::pair<int, int> > &removed) 
+    {
+        assert(m_finalized && other.IsFinalized() && other.GetNumRows() >= GetNumRows());
+
+        int oldRows = GetNumRows();
+        int n = other.GetNumRows();
+
+        const vector<int> &otherPtr = other.GetRowPtr();
+        const vector<int> &otherCol = other.GetColIdx();
+        const vector<T> &otherVal = other.GetValues();
+
+        vector<int> rowPtr(n + 1);
+        vector<int> colIdx;
+        vector<T> values;
+        colIdx.reserve(m_colIdx.size() + otherCol.size());
+        values.reserve(m_colIdx.size() + otherCol.size());
+
+        size_t r = 0;
+        rowPtr[0] = 0;
+        for(int row=0; row<n; row++)
+        {
+            int k = row < oldRows ? m_rowPtr[row] : 0;
+            int kEnd = row < oldRows ? m_rowPtr[row + 1] : 0;
+            int l = otherPtr[row];
+            int lEnd = otherPtr[row + 1];
+
+            while(k < kEnd || l < lEnd)
+            {
+                int col;
+                T val = 0;
+
+                if(l == lEnd || (k < kEnd && m_colIdx[k] < otherCol[l]))
+                {
+                    col = m_colIdx[k];
+                    val = m_values[k++];
+                }
+                else if(k == kEnd || otherCol[l] < m_colIdx[k])
+                {
+                    col = otherCol[l];
+                    val = otherVal[l++];
+                }
+                else
+                {
+                    col = m_colIdx[k];
+                    val = m_values[k++] + otherVal[l++];
+                }
+
+                while(r < removed.size() && removed[r] < std::make_pair(row, col))
+                    r++;
+                if(r < removed.size() && removed[r] == std::make_pair(row, col))
+                    continue;
+
+                colIdx.push_back(col);
+                values.push_back(val);
+            }
+
+            rowPtr[row + 1] = (int)colIdx.size();
+        }
+
+        SetCSR(n, rowPtr, colIdx, values);
+    }
+
+    /* Finalized copy of a finalized matrix of another precision */
+    template<class S>
+    void ConvertFrom(const SparseSymmetricMatrixT<S> &other) 
+    {
+        vector<int> rowPtr = other.GetRowPtr();
+        vector<int> colIdx = other.GetColIdx();
+        vector<T> values(other.GetValues().begin(), other.GetValues().end());
+
+        SetCSR(other.GetNumRows(), rowPtr, colIdx, values);
+    }
+
+    int GetNumNonZeros() const { return (int)m_values.size(); }
+
+    const vector<int> &GetRowPtr() const { return m_rowPtr; }
+    const vector<int> &GetColIdx() const { return m_colIdx; }
+    const vector<T> &GetValues() const { return m_values; }
+    vector<T> &GetValues() 
+    { 
+        modified();
+        return m_values; 
+    }
+
+    /* Selects the product kernel used by MultVector once finalized */
+    void SetSpMVBackend(SpMVBackend backend) { m_backend = backend; }
+    SpMVBackend GetSpMVBackend() const { return m_backend; }
+
     void MultVector(const vector<T> &x, vector<T> &b) const 
     {
+        if(m_finalized && m_backend == SPMV_SELL)
+        {
+            MultVectorSell(x, b);
+            return;
+        }
+
+        /* Gathered at any number of threads, also 1, so the sums do
+           not depend on the thread count */
+        if(m_finalized)
+        {
+            MultVectorGather(x, b);
+            return;
+        }
+
         for(int i=0; i<(int)b.size(); i++)
             b[i] = 0;
 
@@ -80,11 +311,184 @@ public:
         }
     }
 
+    /* Row-parallel product using the transpose index: every b[row] is 
+       summed by one thread only, in a fixed order, so the result does 
+       not depend on the number of threads. Requires Finalize(). */
+    void MultVectorGather(const vector<T> &x, vector<T> &b) const 
+    {
+        int nrows = GetNumRows();
+
+#pragma omp parallel for schedule(static)
+        for(int row=0; row<nrows; row++)
+        {
+            T rowSum = 0;
+
+            for(int k=m_rowPtr[row]; k<m_rowPtr[row + 1]; k++)
+                rowSum += m_values[k] * x[m_colIdx[k]];
+
+            for(int k=m_upperPtr[row]; k<m_upperPtr[row + 1]; k++)
+                rowSum += m_values[m_upperSrc[k]] * x[m_upperCol[k]];
+
+            b[row] = rowSum;
+        }
+    }
+
+    /* B = A*X for numVectors vectors stored interleaved, entry j of 
+       vector v at X[j*numVectors + v]: every matrix entry is loaded once 
+       and applied to all vectors. Requires Finalize(). */
+    void MultMultiVector(const vector<T> &X, vector<T> &B, int numVectors) const 
+    {
+        /* Fixed block widths let the compiler unroll/vectorize the 
+           inner loops */
+        switch(numVectors)
+        {
+        case 1: MultMultiVectorT<1>(X, B, 1); break;
+        case 2: MultMultiVectorT<2>(X, B, 2); break;
+        case 4: MultMultiVectorT<4>(X, B, 4); break;
+        case 8: MultMultiVectorT<8>(X, B, 8); break;
+        case 16: MultMultiVectorT<16>(X, B, 16); break;
+        default: MultMultiVectorT<0>(X, B, numVectors); break;
+        }
+    }
+
+    /* Product through the SELL-C-sigma copy; layout and values are 
+       (re)built on demand. Requires Finalize(). */
+    void MultVectorSell(const vector<T> &x, vector<T> &b) const 
+    {
+        if(!m_sellLayoutValid)
+        {
+            m_sell.Build(GetNumRows(), m_rowPtr.data(), m_colIdx.data(), 
+                         m_upperPtr.data(), m_upperCol.data(), m_upperSrc.data(), 
+                         m_values.data());
+            m_sellLayoutValid = true;
+            m_sellStale = false;
+        }
+        else if(m_sellStale)
+        {
+            m_sell.Refresh(m_values.data());
+            m_sellStale = false;
+        }
+
+        m_sell.MultVector(x, b);
+    }
+
+    /* Same result as calling FixSolution(b, idx[k], values[k]) for all k
+       in ascending order of idx, in a single pass over the matrix instead
+       of one pass per fixed index. Finalizes the matrix. */
+    void FixSolutions(std::vector<T> &b, const vector<int> &idx, const vector<T> &values) 
+    {
+        Finalize();
+
+        int nrows = GetNumRows();
+
+        vector<char> fixed(nrows, 0);
+        vector<T> known(nrows, T(0));
+        for(int k=0; k<(int)idx.size(); k++)
+        {
+            fixed[idx[k]] = 1;
+            known[idx[k]] = values[k];
+        }
+
+        FixRHS(b, fixed, known, b);
+        FixMatrix(fixed);
+    }
+
+    /* The two halves of FixSolutions, for systems solved repeatedly with
+       the same fixed entries: FixRHS computes the right-hand side from
+       the unmodified (finalized) matrix, result may be b itself. 
+       FixMatrix decouples the fixed rows and columns of a copy once. */
+    void FixRHS(const std::vector<T> &b, const vector<char> &fixed, const vector<T> &known, 
+                std::vector<T> &result) const 
+    {
+        assert(m_finalized);
+
+        int nrows = GetNumRows();
+        result.resize(nrows);
+
+        /* Move the known values to the right-hand side. Every free row 
+           gathers its fixed columns from its lower part, then from the 
+           transposed upper part, i.e. in ascending column order like the
+           sequence of FixSolution calls. */
+#pragma omp parallel for schedule(static)
+        for(int row=0; row<nrows; row++)
+        {
+            if(fixed[row])
+            {
+                result[row] = known[row];
+                continue;
+            }
+
+            T sum = b[row];
+
+            for(int k=m_rowPtr[row]; k<m_rowPtr[row + 1]; k++)
+                if(fixed[m_colIdx[k]] && m_values[k] != 0)
+                    sum -= m_values[k] * known[m_colIdx[k]];
+
+            for(int k=m_upperPtr[row]; k<m_upperPtr[row + 1]; k++)
+                if(fixed[m_upperCol[k]] && m_values[m_upperSrc[k]] != 0)
+                    sum -= m_values[m_upperSrc[k]] * known[m_upperCol[k]];
+
+            result[row] = sum;
+        }
+    }
+
+    void FixMatrix(const vector<char> &fixed) 
+    {
+        Finalize();
+
+        int nrows = GetNumRows();
+        modified();
+
+#pragma omp parallel for schedule(static)
+        for(int row=0; row<nrows; row++)
+        {
+            for(int k=m_rowPtr[row]; k<m_rowPtr[row + 1]; k++)
+            {
+                int col = m_colIdx[k];
+
+                if(col == row && fixed[row])
+                    m_values[k] = 1;
+                else if(fixed[row] || fixed[col])
+                    m_values[k] = 0;
+            }
+        }
+    }
+
     /* Modifies matrix and vector b so that linear system 'A*x = b' will have solution 
        "value" at index "idx". */
     void FixSolution(std::vector<T> &b, int idx, T value) 
     {
         int n = (int)b.size();
+
+        modified();
+
+        if(m_finalized)
+        {
+            for(int k=m_rowPtr[idx]; k<m_rowPtr[idx + 1]; k++)
+            {
+                int col = m_colIdx[k];
+
+                b[col] -= m_values[k] * value;
+
+                if(col == idx)
+                    m_values[k] = 1;
+                else
+                    m_values[k] = 0;
+            }
+
+            b[idx] = value;
+
+            for(int i=idx+1; i<n; i++)
+            {
+                int k = FindOffset(i, idx);
+                if(k >= 0 && m_values[k] != 0)
+                {
+                    b[i] -= m_values[k] * value;
+                    m_values[k] = 0;
+                }
+            }
+            return;
+        }
         
         map<int, T> &rowData = m_rowData[idx];
 
@@ -125,17 +529,37 @@ public:
 
     const T &GetAt(int row, int col) const 
     {
+        if(m_finalized)
+        {
+            int k = FindOffset(row, col);
+            if(k < 0)
+                return s_zero;
+
+            return m_values[k];
+        }
+
         const map<int, T> &rowData = m_rowData[row];
         
         typename map<int, T>::const_iterator iter = rowData.find(col);
         if(iter == rowData.end())
-            return 0;
+            return s_zero;
         
         return iter->second;
     }
 
     T &GetAt(int row, int col) 
     {
+        modified();
+
+        if(m_finalized)
+        {
+            /* Pattern is frozen, entries cannot be created anymore */
+            int k = FindOffset(row, col);
+            assert(k >= 0);
+
+            return m_values[k];
+        }
+
         map<int, T> &rowData = m_rowData[row];
         
         typename map<int, T>::iterator iter = rowData.find(col);
@@ -148,14 +572,150 @@ public:
         return iter->second;
     }
     
-    int GetNumRows() const { return m_rowData.size(); }
+    void GetDiagonal(vector<T> &diag) const 
+    {
+        int n = GetNumRows();
+
+        diag.resize(n);
+        for(int i=0; i<n; i++)
+            diag[i] = GetAt(i, i);
+    }
+
+    int GetNumRows() const 
+    { 
+        return m_finalized ? (int)m_rowPtr.size() - 1 : (int)m_rowData.size(); 
+    }
     int GetNumCols() const { return m_numCols; }
 
+    /* Estimated memory traffic of MultVector (or MultMultiVector) on the 
+       finalized matrix: values and column indices once, row pointers, 
+       x and b */
+    double GetProductBytes(int numVectors = 1) const 
+    {
+        double nnz = GetNumNonZeros();
+        double n = GetNumRows();
+
+        return nnz * (sizeof(T) + sizeof(int)) + n * (sizeof(int) + 2.0 * numVectors * sizeof(T));
+    }
+
 private:
+    /* Kernel of MultMultiVector; NV > 0 fixes the number of vectors at 
+       compile time, NV = 0 takes it from numVectors */
+    template<int NV>
+    void MultMultiVectorT(const vector<T> &X, vector<T> &B, int numVectors) const 
+    {
+        const int nv = NV > 0 ? NV : numVectors;
+        int nrows = GetNumRows();
+
+        /* Gathered like MultVectorGather, at any number of threads */
+#pragma omp parallel for schedule(static)
+        for(int row=0; row<nrows; row++)
+        {
+            T sum[NV > 0 ? NV : 1];
+            T *bRow = NV > 0 ? sum : &B[row * nv];
+            for(int v=0; v<nv; v++)
+                bRow[v] = 0;
+
+            for(int k=m_rowPtr[row]; k<m_rowPtr[row + 1]; k++)
+            {
+                T val = m_values[k];
+                const T *xCol = &X[m_colIdx[k] * nv];
+                for(int v=0; v<nv; v++)
+                    bRow[v] += val * xCol[v];
+            }
+
+            for(int k=m_upperPtr[row]; k<m_upperPtr[row + 1]; k++)
+            {
+                T val = m_values[m_upperSrc[k]];
+                const T *xCol = &X[m_upperCol[k] * nv];
+                for(int v=0; v<nv; v++)
+                    bRow[v] += val * xCol[v];
+            }
+
+            if(NV > 0)
+                for(int v=0; v<nv; v++)
+                    B[row * nv + v] = sum[v];
+        }
+    }
+
+    void modified() 
+    {
+        m_sellStale = true;
+        m_generation = nextGeneration();
+    }
+
+    static uint64_t nextGeneration() 
+    {
+        static std::atomic<uint64_t> counter(0);
+        return ++counter;
+    }
+
+    /* Transposes the strictly lower triangle: row r of the upper part 
+       lists (col, index into m_values) of all entries (col, r), col > r */
+    void BuildTransposeIndex() 
+    {
+        int nrows = GetNumRows();
+
+        m_sellLayoutValid = false;
+
+        m_upperPtr.assign(nrows + 1, 0);
+        for(int row=0; row<nrows; row++)
+            for(int k=m_rowPtr[row]; k<m_rowPtr[row + 1]; k++)
+                if(m_colIdx[k] < row)
+                    m_upperPtr[m_colIdx[k] + 1]++;
+
+        for(int row=0; row<nrows; row++)
+            m_upperPtr[row + 1] += m_upperPtr[row];
+
+        m_upperCol.resize(m_upperPtr[nrows]);
+        m_upperSrc.resize(m_upperPtr[nrows]);
+
+        vector<int> fill(m_upperPtr.begin(), m_upperPtr.end() - 1);
+        for(int row=0; row<nrows; row++)
+        {
+            for(int k=m_rowPtr[row]; k<m_rowPtr[row + 1]; k++)
+            {
+                int col = m_colIdx[k];
+                if(col < row)
+                {
+                    int pos = fill[col]++;
+                    m_upperCol[pos] = row;
+                    m_upperSrc[pos] = k;
+                }
+            }
+        }
+    }
+
     int m_numCols;
+    bool m_finalized;
+
+    /* Build phase: one ordered map per row */
     vector<map<int, T> > m_rowData;
+
+    /* Finalized phase: compressed-row storage */
+    vector<int> m_rowPtr;
+    vector<int> m_colIdx;
+    vector<T> m_values;
+
+    /* Finalized phase: transpose index of the strictly lower triangle */
+    vector<int> m_upperPtr;
+    vector<int> m_upperCol;
+    vector<int> m_upperSrc;
+
+    /* Optional SELL-C-sigma copy, built on first use */
+    SpMVBackend m_backend;
+    mutable SellCSigmaMatrixT<T> m_sell;
+    mutable bool m_sellLayoutValid;
+    mutable bool m_sellStale;
+
+    uint64_t m_generation;
+
+    static const T s_zero;
 };
 
+template<class T>
+const T SparseSymmetricMatrixT<T>::s_zero = 0;
+
 typedef SparseSymmetricMatrixT<double> SparseSymmetricMatrix;
 
 #endif
@@ -0,0 +1,160 @@
+/******************************************************************
+*
+* SparseTriplets.h
+*
+* Description: 
+*
+* Coordinate (triplet) builder for SparseSymmetricMatrixT. Entries
+* (row, col, value) are appended to preallocated flat arrays and 
+* converted into a finalized CSR matrix in one go: a two-pass radix
+* (counting) sort orders them by row and column, then duplicates are
+* summed. Duplicates are added in insertion order, so the result is
+* identical to accumulating the same sequence into the matrix directly.
+* Note: Only lower-triagonal entries (col <= row) may be added.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __SPARSETRIPLETS_T_H__
+#define __SPARSETRIPLETS_T_H__
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "SparseSymMat.h"
+
+using std::vector;
+
+template<class T>
+class SparseTripletBuilderT
+{
+public:
+    SparseTripletBuilderT() 
+    {
+        m_numRowsCols = 0;
+    }
+
+    /* Discards all entries; storage for expectedEntries triplets is 
+       reserved so that Add() does not reallocate. */
+    void Reset(int numRowsCols, int expectedEntries) 
+    {
+        m_numRowsCols = numRowsCols;
+
+        m_rows.clear();
+        m_cols.clear();
+        m_vals.clear();
+
+        m_rows.reserve(expectedEntries);
+        m_cols.reserve(expectedEntries);
+        m_vals.reserve(expectedEntries);
+    }
+
+    void Add(int row, int col, T val) 
+    {
+        assert(col <= row && row < m_numRowsCols);
+
+        m_rows.push_back(row);
+        m_cols.push_back(col);
+        m_vals.push_back(val);
+    }
+
+    int GetNumEntries() const { return (int)m_vals.size(); }
+
+    /* Sorts the triplets, sums duplicates and stores the result as
+       finalized CSR matrix in mat. */
+    void BuildMatrix(SparseSymmetricMatrixT<T> &mat) 
+    {
+        int n = m_numRowsCols;
+        int numEntries = GetNumEntries();
+
+        /* Pass 1: stable counting sort by column into temporary arrays */
+        vector<int> count(n + 1);
+        for(int k=0; k<numEntries; k++)
+            count[m_cols[k] + 1]++;
+        for(int i=0; i<n; i++)
+            count[i + 1] += count[i];
+
+        m_tmpRows.resize(numEntries);
+        m_tmpCols.resize(numEntries);
+        m_tmpVals.resize(numEntries);
+
+        for(int k=0; k<numEntries; k++)
+        {
+            int pos = count[m_cols[k]]++;
+            m_tmpRows[pos] = m_rows[k];
+            m_tmpCols[pos] = m_cols[k];
+            m_tmpVals[pos] = m_vals[k];
+        }
+
+        /* Pass 2: stable counting sort by row; keeps columns ascending 
+           and duplicates in insertion order */
+        std::fill(count.begin(), count.end(), 0);
+        for(int k=0; k<numEntries; k++)
+            count[m_tmpRows[k] + 1]++;
+        for(int i=0; i<n; i++)
+            count[i + 1] += count[i];
+
+        vector<int> rowStart(count.begin(), count.end());
+
+        for(int k=0; k<numEntries; k++)
+        {
+            int pos = count[m_tmpRows[k]]++;
+            m_cols[pos] = m_tmpCols[k];
+            m_vals[pos] = m_tmpVals[k];
+        }
+
+        /* Reduce duplicates, compacting every row in place */
+        vector<int> rowPtr(n + 1);
+        vector<int> colIdx;
+        vector<T> values;
+        colIdx.reserve(numEntries);
+        values.reserve(numEntries);
+
+        rowPtr[0] = 0;
+        for(int row=0; row<n; row++)
+        {
+            for(int k=rowStart[row]; k<rowStart[row + 1]; k++)
+            {
+                int last = (int)colIdx.size() - 1;
+
+                if(last >= rowPtr[row] && colIdx[last] == m_cols[k])
+                    values[last] += m_vals[k];
+                else
+                {
+                    colIdx.push_back(m_cols[k]);
+                    values.push_back(m_vals[k]);
+                }
+            }
+            rowPtr[row + 1] = (int)colIdx.size();
+        }
+
+        /* m_rows no longer matches the sorted order */
+        m_rows.clear();
+        m_cols.clear();
+        m_vals.clear();
+
+        mat.SetCSR(n, rowPtr, colIdx, values);
+    }
+
+private:
+    int m_numRowsCols;
+
+    vector<int> m_rows;
+    vector<int> m_cols;
+    vector<T> m_vals;
+
+    /* Scratch buffers for the radix sort, kept to avoid reallocation */
+    vector<int> m_tmpRows;
+    vector<int> m_tmpCols;
+    vector<T> m_tmpVals;
+};
+
+typedef SparseTripletBuilderT<double> SparseTripletBuilder;
+
+#endif
@@ -0,0 +1,581 @@
+/******************************************************************
+*
+* TriangleMesh.h
+*
+* Description: 
+*
+* Compact mesh of linear triangles in structure-of-arrays layout:
+* node positions, boundary markers (nonzero: node on the boundary), 
+* int32 connectivity (three IDs per triangle) and, after 
+* UpdateGeometry(), the element areas and the constant gradients
+* of the three basis functions. An element costs 68 bytes, all of 
+* which element loops actually read, and every array is traversed 
+* with unit stride.
+*
+* Refine() implements newest vertex bisection, BuildEdges() provides
+* the edge/triangle adjacency (e.g. for error estimators).
+*
+* Elements are accessed through lightweight views (Element) that 
+* only hold the mesh pointer and the element index, either by index
+* or with the iterators:
+*
+*   for(TriangleMesh::ElementIterator it = mesh.begin(); it != mesh.end(); ++it)
+*       area += it->GetArea();
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __TRIANGLEMESH_H__
+#define __TRIANGLEMESH_H__
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+
+#include "Vec2.h"
+
+using std::vector;
+
+/* Changes made by TriangleMesh::Refine(), for updating data that is
+   attached to nodes and triangles */
+struct TriangleRefinement
+{
+    vector<int> parents;         /* Refined triangles */
+    vector<int32_t> parentNodes; /* Their nodes, three per parent */
+    vector<int> children;        /* Triangles replacing them; the first child 
+                                    of each parent takes over its index */
+    vector<int32_t> bisections;  /* Bisected edge (a, b) and its midpoint, 
+                                    three per edge; midpoints are new nodes */
+};
+
+class TriangleMesh
+{
+public:
+    /* View of one triangle */
+    class Element
+    {
+    public:
+        Element(const TriangleMesh *mesh, int index) : m_mesh(mesh), m_index(index) {}
+
+        int GetIndex() const { return m_index; }
+
+        /* Global ID of local node a (0..2) */
+        int GetNode(int a) const { return m_mesh->m_conn[3 * m_index + a]; }
+
+        const Vector2 &GetNodePosition(int a) const { return m_mesh->m_nodes[GetNode(a)]; }
+
+        double GetArea() const { return m_mesh->m_area[m_index]; }
+
+        /* Gradient of the basis function of local node a */
+        Vector2 GetGradient(int a) const 
+        {
+            return Vector2(m_mesh->m_gradX[3 * m_index + a], m_mesh->m_gradY[3 * m_index + a]);
+        }
+
+        Vector2 GetCenter() const 
+        {
+            return (GetNodePosition(0) + GetNodePosition(1) + GetNodePosition(2)) / 3;
+        }
+
+        /* The 6 distinct entries area * grad N_i . grad N_j of the element 
+           stiffness matrix, (i, j) as listed by GetStiffnessPair() */
+        void ComputeStiffness(double stiffness[6]) const 
+        {
+            TriangleMesh::ComputeStiffness(GetArea(), &m_mesh->m_gradX[3 * m_index], 
+                                           &m_mesh->m_gradY[3 * m_index], stiffness);
+        }
+
+    private:
+        const TriangleMesh *m_mesh;
+        int m_index;
+    };
+
+    class ElementIterator
+    {
+    public:
+        ElementIterator(const TriangleMesh *mesh, int index) 
+            : m_mesh(mesh), m_element(mesh, index) {}
+
+        const Element &operator*() const { return m_element; }
+        const Element *operator->() const { return &m_element; }
+
+        ElementIterator &operator++() 
+        {
+            m_element = Element(m_mesh, m_element.GetIndex() + 1);
+            return *this;
+        }
+
+        bool operator==(const ElementIterator &other) const 
+        { 
+            return m_element.GetIndex() == other.m_element.GetIndex(); 
+        }
+        bool operator!=(const ElementIterator &other) const { return !(*this == other); }
+
+    private:
+        const TriangleMesh *m_mesh;
+        Element m_element;
+    };
+
+    TriangleMesh() 
+    { 
+        m_geometryValid = false; 
+        m_bisectionReady = false;
+    }
+
+    void Clear() 
+    {
+        m_nodes.clear();
+        m_marker.clear();
+        m_conn.clear();
+        m_area.clear();
+        m_gradX.clear();
+        m_gradY.clear();
+        m_geometryValid = false;
+        m_bisectionReady = false;
+    }
+
+    void Reserve(int numNodes, int numTriangles) 
+    {
+        m_nodes.reserve(numNodes);
+        m_marker.reserve(numNodes);
+        m_conn.reserve(3 * numTriangles);
+    }
+
+    int AddNode(const Vector2 &pos, int marker = 0) 
+    {
+        m_nodes.push_back(pos);
+        m_marker.push_back(marker);
+        m_geometryValid = false;
+        return (int)m_nodes.size() - 1;
+    }
+
+    int AddTriangle(int node0, int node1, int node2) 
+    {
+        m_conn.push_back(node0);
+        m_conn.push_back(node1);
+        m_conn.push_back(node2);
+        m_geometryValid = false;
+        m_bisectionReady = false;
+        return GetNumTriangles() - 1;
+    }
+
+    int GetNumNodes() const { return (int)m_nodes.size(); }
+    int GetNumTriangles() const { return (int)m_conn.size() / 3; }
+
+    const Vector2 &GetNode(int nodeID) const { return m_nodes[nodeID]; }
+    const vector<Vector2> &GetNodes() const { return m_nodes; }
+
+    int GetNodeMarker(int nodeID) const { return m_marker[nodeID]; }
+    const vector<int32_t> &GetNodeMarkers() const { return m_marker; }
+    void SetNodeMarker(int nodeID, int marker) { m_marker[nodeID] = marker; }
+
+    /* Three node IDs per triangle */
+    const int32_t *GetConnectivity() const { return m_conn.data(); }
+
+    Element GetElement(int index) const { return Element(this, index); }
+
+    ElementIterator begin() const { return ElementIterator(this, 0); }
+    ElementIterator end() const { return ElementIterator(this, GetNumTriangles()); }
+
+    /* Recomputes areas and basis gradients after nodes or triangles 
+       changed; element data is only valid afterwards */
+    void UpdateGeometry() 
+    {
+        int numTris = GetNumTriangles();
+
+        m_area.resize(numTris);
+        m_gradX.resize(3 * numTris);
+        m_gradY.resize(3 * numTris);
+
+#pragma omp parallel for schedule(static)
+        for(int e=0; e<numTris; e++)
+            ComputeGeometry(m_nodes[m_conn[3 * e]], m_nodes[m_conn[3 * e + 1]], m_nodes[m_conn[3 * e + 2]],
+                            m_area[e], &m_gradX[3 * e], &m_gradY[3 * e]);
+
+        m_geometryValid = true;
+    }
+
+    /* Same for the listed triangles only, the others must be up to date */
+    void UpdateGeometry(const vector<int> &triangles) 
+    {
+        int numTris = GetNumTriangles();
+
+        m_area.resize(numTris);
+        m_gradX.resize(3 * numTris);
+        m_gradY.resize(3 * numTris);
+
+#pragma omp parallel for schedule(static)
+        for(int k=0; k<(int)triangles.size(); k++)
+        {
+            int e = triangles[k];
+            ComputeGeometry(m_nodes[m_conn[3 * e]], m_nodes[m_conn[3 * e + 1]], m_nodes[m_conn[3 * e + 2]],
+                            m_area[e], &m_gradX[3 * e], &m_gradY[3 * e]);
+        }
+
+        m_geometryValid = true;
+    }
+
+    /* Area and basis function gradients of the triangle (p0, p1, p2) */
+    static void ComputeGeometry(const Vector2 &p0, const Vector2 &p1, const Vector2 &p2, 
+                                double &area, double gradX[3], double gradY[3]) 
+    {
+        /* Twice the signed area */
+        double det = (p1[0] - p0[0]) * (p2[1] - p0[1]) - (p2[0] - p0[0]) * (p1[1] - p0[1]);
+
+        area = 0.5 * fabs(det);
+
+        /* N_a is one at node a and zero on the opposite edge (b, c): 
+           grad N_a = perp(p_c - p_b) / det */
+        gradX[0] = (p1[1] - p2[1]) / det;
+        gradY[0] = (p2[0] - p1[0]) / det;
+        gradX[1] = (p2[1] - p0[1]) / det;
+        gradY[1] = (p0[0] - p2[0]) / det;
+        gradX[2] = (p0[1] - p1[1]) / det;
+        gradY[2] = (p1[0] - p0[0]) / det;
+    }
+
+    /* The 6 distinct entries area * grad N_i . grad N_j of a stiffness 
+       matrix, (i, j) as listed by GetStiffnessPair() */
+    static void ComputeStiffness(double area, const double gradX[3], const double gradY[3], 
+                                 double stiffness[6]) 
+    {
+        for(int k=0; k<6; k++)
+        {
+            int i = GetStiffnessPair(k, 0);
+            int j = GetStiffnessPair(k, 1);
+            stiffness[k] = (gradX[i] * gradX[j] + gradY[i] * gradY[j]) * area;
+        }
+    }
+
+    bool IsGeometryValid() const { return m_geometryValid; }
+
+    /* Renumbers the nodes, perm[new] = old */
+    void PermuteNodes(const vector<int> &perm) 
+    {
+        int n = GetNumNodes();
+
+        vector<int> inv(n);
+        vector<Vector2> oldNodes = m_nodes;
+        vector<int32_t> oldMarker = m_marker;
+        for(int i=0; i<n; i++)
+        {
+            inv[perm[i]] = i;
+            m_nodes[i] = oldNodes[perm[i]];
+            m_marker[i] = oldMarker[perm[i]];
+        }
+
+        for(int k=0; k<(int)m_conn.size(); k++)
+            m_conn[k] = inv[m_conn[k]];
+    }
+
+    /* Drops nodes no triangle refers to (e.g. edge nodes of imported 
+       higher-order elements), keeping the order of the others */
+    void RemoveUnusedNodes() 
+    {
+        int n = GetNumNodes();
+
+        vector<int> newID(n, -1);
+        for(int k=0; k<(int)m_conn.size(); k++)
+            newID[m_conn[k]] = 0;
+
+        int numUsed = 0;
+        for(int i=0; i<n; i++)
+        {
+            if(newID[i] < 0)
+                continue;
+
+            newID[i] = numUsed;
+            m_nodes[numUsed] = m_nodes[i];
+            m_marker[numUsed] = m_marker[i];
+            numUsed++;
+        }
+
+        m_nodes.resize(numUsed);
+        m_marker.resize(numUsed);
+
+        for(int k=0; k<(int)m_conn.size(); k++)
+            m_conn[k] = newID[m_conn[k]];
+
+        m_geometryValid = false;
+    }
+
+    /* Sets marker on the nodes of all edges that belong to one triangle 
+       only, for meshes that come without boundary information */
+    void MarkBoundaryNodes(int marker = 1) 
+    {
+        int numTris = GetNumTriangles();
+
+        vector<uint64_t> edges(3 * numTris);
+        for(int e=0; e<numTris; e++)
+        {
+            for(int a=0; a<3; a++)
+            {
+                uint64_t i = (uint32_t)m_conn[3 * e + a];
+                uint64_t j = (uint32_t)m_conn[3 * e + (a + 1) % 3];
+                edges[3 * e + a] = i < j ? (i << 32) | j : (j << 32) | i;
+            }
+        }
+
+        std::sort(edges.begin(), edges.end());
+
+        for(int k=0; k<(int)edges.size(); )
+        {
+            int next = k + 1;
+            while(next < (int)edges.size() && edges[next] == edges[k])
+                next++;
+
+            if(next - k == 1)
+            {
+                m_marker[(int)(edges[k] >> 32)] = marker;
+                m_marker[(int)(edges[k] & 0xffffffffu)] = marker;
+            }
+            k = next;
+        }
+    }
+
+    /* Unique edges: edgeNodes gets the two nodes of each edge, 
+       edgeElements the two adjacent triangles (the second is -1 on the 
+       boundary) and elementEdges, for every triangle, its edges (v0, v1),
+       (v1, v2) and (v2, v0) */
+    void BuildEdges(vector<int32_t> &edgeNodes, vector<int32_t> &edgeElements, 
+                    vector<int32_t> &elementEdges) const
+    {
+        int numTris = GetNumTriangles();
+
+        /* Bucket the half edges by their smaller node (counting sort); 
+           both sides of an edge meet in one short bucket */
+        int numNodes = GetNumNodes();
+        vector<int> bucketStart(numNodes + 1, 0);
+        for(int h=0; h<3 * numTris; h++)
+            bucketStart[std::min(m_conn[h], m_conn[nextHalfEdge(h)]) + 1]++;
+        for(int i=0; i<numNodes; i++)
+            bucketStart[i + 1] += bucketStart[i];
+
+        vector<int> halfEdges(3 * numTris);
+        vector<int> pos(bucketStart.begin(), bucketStart.end() - 1);
+        for(int h=0; h<3 * numTris; h++)
+            halfEdges[pos[std::min(m_conn[h], m_conn[nextHalfEdge(h)])]++] = h;
+
+        edgeNodes.clear();
+        edgeElements.clear();
+        elementEdges.resize(3 * numTris);
+
+        for(int i=0; i<numNodes; i++)
+        {
+            int firstEdge = (int)edgeNodes.size() / 2;
+
+            for(int k=bucketStart[i]; k<bucketStart[i + 1]; k++)
+            {
+                int h = halfEdges[k];
+                int j = std::max(m_conn[h], m_conn[nextHalfEdge(h)]);
+
+                int edge = firstEdge;
+                while(edge < (int)edgeNodes.size() / 2 && edgeNodes[2 * edge + 1] != j)
+                    edge++;
+
+                if(edge == (int)edgeNodes.size() / 2)
+                {
+                    edgeNodes.push_back(i);
+                    edgeNodes.push_back(j);
+                    edgeElements.push_back(h / 3);
+                    edgeElements.push_back(-1);
+                }
+                else if(h / 3 != edgeElements[2 * edge])
+                    edgeElements[2 * edge + 1] = h / 3;
+
+                elementEdges[h] = edge;
+            }
+        }
+    }
+
+    /* Newest vertex bisection. The edge (v0, v1) is the refinement edge of
+       a triangle; bisecting it at its midpoint m gives (v2, v0, m) and 
+       (v1, v2, m), whose refinement edges are the other two edges of the 
+       parent. Marked triangles are bisected three times, so all their 
+       edges are halved, and neighbors as far as needed to keep the mesh 
+       conforming. Before the first refinement of a mesh the longest edge
+       of every triangle becomes its refinement edge (which rotates the 
+       node order). A midpoint of a boundary edge gets the marker of the 
+       edge's first node if both nodes are marked. Geometry is updated. */
+    void Refine(const vector<int> &marked, TriangleRefinement &result) 
+    {
+        result.parents.clear();
+        result.parentNodes.clear();
+        result.children.clear();
+        result.bisections.clear();
+
+        bool rotated = false;
+        if(!m_bisectionReady)
+        {
+            rotateLongestEdgeFirst();
+            rotated = true;
+        }
+
+        vector<int32_t> edgeNodes, edgeElements, elementEdges;
+        BuildEdges(edgeNodes, edgeElements, elementEdges);
+
+        int numTris = GetNumTriangles();
+        int numEdges = (int)edgeNodes.size() / 2;
+
+        /* Closure: a triangle with any edge to bisect bisects its 
+           refinement edge first */
+        vector<char> edgeMarked(numEdges, 0);
+        vector<int> queue;
+
+        for(int k=0; k<(int)marked.size(); k++)
+        {
+            for(int a=0; a<3; a++)
+            {
+                int edge = elementEdges[3 * marked[k] + a];
+                if(!edgeMarked[edge])
+                {
+                    edgeMarked[edge] = 1;
+                    queue.push_back(edge);
+                }
+            }
+        }
+
+        for(int head=0; head<(int)queue.size(); head++)
+        {
+            for(int side=0; side<2; side++)
+            {
+                int e = edgeElements[2 * queue[head] + side];
+                if(e < 0)
+                    continue;
+
+                int refEdge = elementEdges[3 * e];
+                if(!edgeMarked[refEdge])
+                {
+                    edgeMarked[refEdge] = 1;
+                    queue.push_back(refEdge);
+                }
+            }
+        }
+
+        vector<int32_t> midpoint(numEdges, -1);
+        for(int edge=0; edge<numEdges; edge++)
+        {
+            if(!edgeMarked[edge])
+                continue;
+
+            int a = edgeNodes[2 * edge];
+            int b = edgeNodes[2 * edge + 1];
+
+            bool boundary = (edgeElements[2 * edge + 1] < 0);
+            int marker = (boundary && m_marker[a] != 0 && m_marker[b] != 0) ? m_marker[a] : 0;
+
+            midpoint[edge] = AddNode((m_nodes[a] + m_nodes[b]) / 2, marker);
+
+            result.bisections.push_back(a);
+            result.bisections.push_back(b);
+            result.bisections.push_back(midpoint[edge]);
+        }
+
+        for(int e=0; e<numTris; e++)
+        {
+            if(!edgeMarked[elementEdges[3 * e]])
+                continue;
+
+            const int32_t *v = &m_conn[3 * e];
+            result.parents.push_back(e);
+            result.parentNodes.insert(result.parentNodes.end(), v, v + 3);
+
+            int slot = e;
+            bisect(v[0], v[1], v[2], 
+                   elementEdges[3 * e], elementEdges[3 * e + 1], elementEdges[3 * e + 2], 
+                   midpoint, slot, result.children);
+        }
+
+        m_bisectionReady = true;
+
+        if(rotated)
+            UpdateGeometry();
+        else
+            UpdateGeometry(result.children);
+    }
+
+    /* Local node pairs (i >= j) of the symmetric element stiffness matrix,
+       the order used by Element::ComputeStiffness */
+    static int GetStiffnessPair(int k, int which) 
+    {
+        static const int pairs[6][2] = { { 0, 0 }, { 1, 1 }, { 2, 2 }, 
+                                         { 1, 0 }, { 2, 0 }, { 2, 1 } };
+        return pairs[k][which];
+    }
+
+private:
+    vector<Vector2> m_nodes;
+    vector<int32_t> m_marker;
+    vector<int32_t> m_conn;
+    vector<double> m_area;
+    vector<double> m_gradX; /* Three per triangle */
+    vector<double> m_gradY;
+    bool m_geometryValid;
+    bool m_bisectionReady; /* Refinement edges are set up (see Refine) */
+
+    /* Half edge h = 3 * e + a runs from node a to node a + 1 of e */
+    static int nextHalfEdge(int h) { return h % 3 == 2 ? h - 2 : h + 1; }
+
+    void rotateLongestEdgeFirst() 
+    {
+        for(int e=0; e<GetNumTriangles(); e++)
+        {
+            int32_t *v = &m_conn[3 * e];
+
+            int longest = 0;
+            double maxLength = -1;
+            for(int a=0; a<3; a++)
+            {
+                Vector2 d = m_nodes[v[(a + 1) % 3]] - m_nodes[v[a]];
+                double length = d[0] * d[0] + d[1] * d[1];
+                if(length > maxLength)
+                {
+                    maxLength = length;
+                    longest = a;
+                }
+            }
+
+            std::rotate(v, v + longest, v + 3);
+        }
+    }
+
+    /* Bisects (v0, v1, v2) recursively as long as its refinement edge e0 
+       has a midpoint; e0..e2 are the edge IDs of (v0, v1), (v1, v2), 
+       (v2, v0) or -1 for edges created by the refinement. The first 
+       triangle produced goes to index slot, the others are appended. */
+    void bisect(int v0, int v1, int v2, int e0, int e1, int e2, 
+                const vector<int32_t> &midpoint, int &slot, vector<int> &children) 
+    {
+        if(e0 < 0 || midpoint[e0] < 0)
+        {
+            if(slot >= 0)
+            {
+                m_conn[3 * slot] = v0;
+                m_conn[3 * slot + 1] = v1;
+                m_conn[3 * slot + 2] = v2;
+                children.push_back(slot);
+                slot = -1;
+            }
+            else
+            {
+                m_conn.push_back(v0);
+                m_conn.push_back(v1);
+                m_conn.push_back(v2);
+                children.push_back(GetNumTriangles() - 1);
+            }
+            return;
+        }
+
+        int m = midpoint[e0];
+        bisect(v2, v0, m, e2, -1, -1, midpoint, slot, children);
+        bisect(v1, v2, m, e1, -1, -1, midpoint, slot, children);
+    }
+};
+
+#endif
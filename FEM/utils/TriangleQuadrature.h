@@ -0,0 +1,101 @@
+/******************************************************************
+*
+* TriangleQuadrature.h
+*
+* Description: 
+*
+* Symmetric Gauss quadrature rules on triangles (Dunavant). A rule of 
+* degree d integrates polynomials up to degree d exactly:
+*
+*   int_T f dA  ~  area * sum_q weights[q] * f(x_q)
+*
+* with x_q given in barycentric coordinates. The barycentric 
+* coordinates of a point equal the values of the three linear basis 
+* functions there, so load vector assembly uses them directly.
+*
+* D. A. Dunavant, "High degree efficient symmetrical Gaussian 
+* quadrature rules for the triangle", Int. J. Numer. Meth. Eng. 21, 
+* 1985.
+*
+* Physically-Based Simulation Proseminar WS 2015
+*
+* Interactive Graphics and Simulation Group
+* Institute of Computer Science
+* University of Innsbruck
+*
+*******************************************************************/
+
+#ifndef __TRIANGLEQUADRATURE_H__
+#define __TRIANGLEQUADRATURE_H__
+
+#include <cassert>
+
+struct TriangleQuadrature
+{
+    int numPoints;
+    const double (*points)[3]; /* Barycentric coordinates */
+    const double *weights;     /* Sum to one */
+};
+
+const int TRIANGLE_QUADRATURE_MAX_DEGREE = 5;
+
+/* Rule exact up to the given degree (1..TRIANGLE_QUADRATURE_MAX_DEGREE) */
+inline TriangleQuadrature GetTriangleQuadrature(int degree) 
+{
+    /* Degree 1: centroid */
+    static const double p1[1][3] = { { 1.0/3.0, 1.0/3.0, 1.0/3.0 } };
+    static const double w1[1] = { 1.0 };
+
+    static const double p2[3][3] = { 
+        { 2.0/3.0, 1.0/6.0, 1.0/6.0 }, 
+        { 1.0/6.0, 2.0/3.0, 1.0/6.0 }, 
+        { 1.0/6.0, 1.0/6.0, 2.0/3.0 } };
+    static const double w2[3] = { 1.0/3.0, 1.0/3.0, 1.0/3.0 };
+
+    /* Note the negative centroid weight */
+    static const double p3[4][3] = { 
+        { 1.0/3.0, 1.0/3.0, 1.0/3.0 }, 
+        { 0.6, 0.2, 0.2 }, 
+        { 0.2, 0.6, 0.2 }, 
+        { 0.2, 0.2, 0.6 } };
+    static const double w3[4] = { -27.0/48.0, 25.0/48.0, 25.0/48.0, 25.0/48.0 };
+
+    static const double p4[6][3] = { 
+        { 0.108103018168070, 0.445948490915965, 0.445948490915965 }, 
+        { 0.445948490915965, 0.108103018168070, 0.445948490915965 }, 
+        { 0.445948490915965, 0.445948490915965, 0.108103018168070 }, 
+        { 0.816847572980459, 0.091576213509771, 0.091576213509771 }, 
+        { 0.091576213509771, 0.816847572980459, 0.091576213509771 }, 
+        { 0.091576213509771, 0.091576213509771, 0.816847572980459 } };
+    static const double w4[6] = { 
+        0.223381589678011, 0.223381589678011, 0.223381589678011, 
+        0.109951743655322, 0.109951743655322, 0.109951743655322 };
+
+    static const double p5[7][3] = { 
+        { 1.0/3.0, 1.0/3.0, 1.0/3.0 }, 
+        { 0.059715871789770, 0.470142064105115, 0.470142064105115 }, 
+        { 0.470142064105115, 0.059715871789770, 0.470142064105115 }, 
+        { 0.470142064105115, 0.470142064105115, 0.059715871789770 }, 
+        { 0.797426985353087, 0.101286507323456, 0.101286507323456 }, 
+        { 0.101286507323456, 0.797426985353087, 0.101286507323456 }, 
+        { 0.101286507323456, 0.101286507323456, 0.797426985353087 } };
+    static const double w5[7] = { 
+        0.225, 
+        0.132394152788506, 0.132394152788506, 0.132394152788506, 
+        0.125939180544827, 0.125939180544827, 0.125939180544827 };
+
+    assert(degree >= 1 && degree <= TRIANGLE_QUADRATURE_MAX_DEGREE);
+
+    TriangleQuadrature rule;
+    switch(degree)
+    {
+    case 1: rule.numPoints = 1; rule.points = p1; rule.weights = w1; break;
+    case 2: rule.numPoints = 3; rule.points = p2; rule.weights = w2; break;
+    case 3: rule.numPoints = 4; rule.points = p3; rule.weights = w3; break;
+    case 4: rule.numPoints = 6; rule.points = p4; rule.weights = w4; break;
+    default: rule.numPoints = 7; rule.points = p5; rule.weights = w5; break;
+    }
+    return rule;
+}
+
+#endif